@@ -0,0 +1,17 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aColor;
+layout(location = 2) in vec3 aOffset;
+layout(location = 3) in vec3 aInstanceColor;
+
+out vec3 ourColor;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+
+void main() {
+    gl_Position = projection * view * model * vec4(aPos + aOffset, 1.0);
+    ourColor = aColor * aInstanceColor;
+}
\ No newline at end of file
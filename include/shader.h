@@ -4,10 +4,12 @@
 #include "glm/glm.hpp"
 #include <glad/glad.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 class Shader {
   public:
@@ -87,60 +89,122 @@ class Shader {
         glDeleteShader(fragment);
         if (geometryPath != nullptr)
             glDeleteShader(geometry);
+        // 3. cache the location of every active uniform
+        cacheUniformLocations();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // uniform locations, resolved once after linking. -1 for names the program doesn't use
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string& name) const {
+        std::unordered_map<std::string, GLint>::const_iterator it = uniformLocations.find(name);
+        return it == uniformLocations.end() ? -1 : it->second;
+    }
+    // utility uniform functions taking a location from getUniformLocation
+    // ------------------------------------------------------------------------
+    void setBool(GLint location, bool value) const {
+        glUniform1i(location, (int)value);
+    }
+    void setInt(GLint location, int value) const {
+        glUniform1i(location, value);
+    }
+    void setFloat(GLint location, float value) const {
+        glUniform1f(location, value);
+    }
+    void setVec2(GLint location, const glm::vec2& value) const {
+        glUniform2fv(location, 1, &value[0]);
+    }
+    void setVec3(GLint location, const glm::vec3& value) const {
+        glUniform3fv(location, 1, &value[0]);
+    }
+    void setVec4(GLint location, const glm::vec4& value) const {
+        glUniform4fv(location, 1, &value[0]);
+    }
+    void setMat2(GLint location, const glm::mat2& mat) const {
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(GLint location, const glm::mat3& mat) const {
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(GLint location, const glm::mat4& mat) const {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // utility uniform functions taking a name
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(getUniformLocation(name), value);
     }
     void setVec2(const std::string& name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(getUniformLocation(name), value);
     }
     void setVec3(const std::string& name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(getUniformLocation(name), value);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(getUniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(getUniformLocation(name), mat);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(getUniformLocation(name), mat);
     }
 
   private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // reflect the active uniforms of the linked program into uniformLocations. Arrays are
+    // reported as "name[0]" so they are also stored under their plain name.
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations() {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(std::max(maxLength, 1), '\0');
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, name.size(), &length, &size, &type, &name[0]);
+            std::string uniform(name.c_str(), length);
+            GLint location = glGetUniformLocation(ID, uniform.c_str());
+            uniformLocations[uniform] = location;
+            size_t bracket = uniform.find("[0]");
+            if (bracket != std::string::npos && bracket + 3 == uniform.size()) {
+                uniformLocations[uniform.substr(0, bracket)] = location;
+            }
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type) {
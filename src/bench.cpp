@@ -0,0 +1,638 @@
+// Headless benchmark of the geometry pipeline. Runs scene creation, intersection marking and vertex
+// packing on a synthetic scene and prints the timings as JSON. The stages, in the order they run:
+//
+// create_geometry       random scene, or copies of --shapes N random shapes.
+// mark_intersections    line/triangle hits through the configured broad and narrow phase, with
+//                       pairs/sec counted against every line/triangle pair.
+// triangle_overlaps     every overlapping pair of triangles through the same broad phase.
+// line_clearance        every pair of lines within --clearance D (0.05 by default).
+// create_vertex_data    packs the marked scene in --vertex-format, vertices/sec.
+// self_check            welds the scene's corners where they are and moved 3000 and 1e6 units out
+//                       and counts corners merged with one further away than the weld distance.
+//                       Also checks that the vertex cache optimizer keeps every triangle. Any
+//                       failure makes the bench exit with 1.
+// instancing            prototypes, bytes and indirect draw calls of the instanced mesh, and
+//                       whether it pays off next to the packed one.
+// rasterize             --raster-frames N frames of the marked scene at --resolution WxH
+//                       (640x480 by default) on the CPU rasterizer.
+// frustum_culling       sorts a copy of the scene along a Morton curve and culls it for
+//                       --cull-views N views (64 by default) looking outward from the center.
+//                       Reports time per view, chunks and ranges kept, multi-draw calls and the
+//                       fraction of the indices still drawn.
+// narrow_phase          ns per test for --narrow-tests N pairs through intersects(), the square
+//                       root free Moller-Trumbore test on triangle records and the exact
+//                       predicates.
+// update_line           moves --updates N random lines one at a time through IntersectionState,
+//                       which keeps the hit pairs and only re-tests triangles near a moved line.
+// update_vertex_data    bytes those edits patch into an unwelded mesh against a full upload.
+// sweep_and_prune       animates the lines for --frames N frames and compares the sorted sweep
+//                       with find_hits() from scratch.
+
+#include "../include/glm/glm.hpp"
+#include "../include/glm/gtc/matrix_transform.hpp"
+#include "constants.hpp"
+#include "culling.hpp"
+#include "draw_commands.hpp"
+#include "geometry.hpp"
+#include "instancing.hpp"
+#include "intersection.hpp"
+#include "intersection_state.hpp"
+#include "scene.hpp"
+#include "simd.hpp"
+#include "software_rasterizer.hpp"
+#include "sweep_and_prune.hpp"
+#include "thread_pool.hpp"
+#include "vertex_data.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <utility>
+#include <vector>
+
+struct BenchConfig {
+    size_t triangle_count;
+    size_t line_count;
+    size_t shape_count; // 0 for every primitive its own shape, see create_repeated_geometry()
+    uint32_t seed;
+    size_t update_count;
+    size_t frame_count;
+    size_t raster_frame_count;
+    size_t cull_view_count;
+    int raster_width;
+    int raster_height;
+    size_t narrow_test_count;
+    float clearance;
+    IntersectionConfig intersection;
+    VertexDataConfig vertex_data;
+    std::string vertex_format;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Items per second, 0 for stages too short to time so the output stays valid JSON
+double rate(double count, double seconds) {
+    return seconds > 0.0 ? count / seconds : 0.0;
+}
+
+double nanoseconds_per_item(double seconds, double count) {
+    return count > 0.0 ? seconds * 1e9 / count : 0.0;
+}
+
+size_t peak_rss_bytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+const char* narrow_phase_name(NarrowPhase narrow_phase) {
+    switch (narrow_phase) {
+    case NarrowPhase::EXACT:
+        return "exact";
+    case NarrowPhase::LEGACY:
+        return "legacy";
+    default:
+        return "segment";
+    }
+}
+
+const char* mode_name(IntersectionMode mode) {
+    switch (mode) {
+    case IntersectionMode::BRUTE_FORCE:
+        return "brute_force";
+    case IntersectionMode::GRID:
+        return "grid";
+    default:
+        return "bvh";
+    }
+}
+
+void create_bench_geometry(const BenchConfig& config, GeometryStore& geometry) {
+    if (config.shape_count > 0) {
+        create_repeated_geometry(geometry.triangles, geometry.lines, config.triangle_count,
+                                 config.line_count, config.shape_count, config.seed);
+    } else {
+        create_random_geometry(geometry.triangles, geometry.lines, config.triangle_count,
+                               config.line_count, config.seed);
+    }
+}
+
+void print_usage() {
+    std::cerr << "usage: bench [--triangles N] [--lines N] [--shapes N] [--seed N] [--threads N]\n"
+              << "             [--updates N] [--frames N] [--narrow-tests N] [--clearance D]\n"
+              << "             [--raster-frames N] [--resolution WxH] [--cull-views N]\n"
+              << "             [--brute-force | --grid] [--exact | --legacy-intersection]\n"
+              << "             [--scalar] [--no-weld]\n"
+              << "             [--vertex-format planar|interleaved|packed|quantized]" << std::endl;
+}
+
+bool parse_args(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--triangles") == 0 && has_value) {
+            config.triangle_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lines") == 0 && has_value) {
+            config.line_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--shapes") == 0 && has_value) {
+            config.shape_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            config.seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--updates") == 0 && has_value) {
+            config.update_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+            config.frame_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cull-views") == 0 && has_value) {
+            config.cull_view_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--raster-frames") == 0 && has_value) {
+            config.raster_frame_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--resolution") == 0 && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &config.raster_width, &config.raster_height) != 2 ||
+                config.raster_width <= 0 || config.raster_height <= 0) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--clearance") == 0 && has_value) {
+            config.clearance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--narrow-tests") == 0 && has_value) {
+            config.narrow_test_count = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            config.intersection.thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--brute-force") == 0) {
+            config.intersection.mode = IntersectionMode::BRUTE_FORCE;
+        } else if (strcmp(argv[i], "--exact") == 0) {
+            config.intersection.narrow_phase = NarrowPhase::EXACT;
+        } else if (strcmp(argv[i], "--legacy-intersection") == 0) {
+            config.intersection.narrow_phase = NarrowPhase::LEGACY;
+        } else if (strcmp(argv[i], "--grid") == 0) {
+            config.intersection.mode = IntersectionMode::GRID;
+        } else if (strcmp(argv[i], "--scalar") == 0) {
+            simd_level = SimdLevel::SCALAR;
+        } else if (strcmp(argv[i], "--no-weld") == 0) {
+            config.vertex_data.weld = false;
+        } else if (strcmp(argv[i], "--vertex-format") == 0 && has_value) {
+            config.vertex_format = argv[++i];
+            if (config.vertex_format == "planar") {
+                config.vertex_data.format = PLANAR_FORMAT;
+            } else if (config.vertex_format == "interleaved") {
+                config.vertex_data.format = INTERLEAVED_FORMAT;
+            } else if (config.vertex_format == "packed") {
+                config.vertex_data.format = PACKED_FORMAT;
+            } else if (config.vertex_format == "quantized") {
+                config.vertex_data.format = QUANTIZED_FORMAT;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Line and triangle pairs for the narrow phase microbenchmark. Every line is paired with triangles
+// around it so a fair share of the pairs gets past the early outs of both tests.
+struct NarrowPhasePairs {
+    std::vector<Line> lines;
+    std::vector<Triangle> triangles;
+    std::vector<TriangleRecord> records;
+};
+
+void make_narrow_phase_pairs(const GeometryStore& geometry, size_t count, uint32_t seed,
+                             NarrowPhasePairs& pairs) {
+    pairs.lines.resize(count);
+    pairs.triangles.resize(count);
+    pairs.records.resize(count);
+    if (geometry.triangles.empty()) {
+        pairs.lines.clear();
+        pairs.triangles.clear();
+        pairs.records.clear();
+        return;
+    }
+    uint32_t state = seed;
+    for (size_t n = 0; n < count; n++) {
+        Triangle triangle = geometry.triangles[n % geometry.triangles.size()];
+        glm::vec3 center = (triangle.a_pos + triangle.b_pos + triangle.c_pos) / 3.0f;
+        Line line;
+        line.a_pos = center + random_vec3(state, -1.0f, 1.0f);
+        line.b_pos = center + random_vec3(state, -1.0f, 1.0f);
+        line.a_col = GREEN_COLOR;
+        line.b_col = GREEN_COLOR;
+        pairs.lines[n] = line;
+        pairs.triangles[n] = triangle;
+        pairs.records[n] = make_triangle_record(triangle.a_pos, triangle.b_pos, triangle.c_pos);
+    }
+}
+
+// Triangle corners of a scene moved by offset, the input create_vertex_data() welds
+void scene_corners(const TriangleStore& triangles, const glm::vec3& offset,
+                   std::vector<glm::vec3>& positions, std::vector<glm::vec3>& colors) {
+    positions.resize(triangles.size() * TRI_VERTEX_COUNT);
+    colors.resize(positions.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        positions[3 * i] = triangles.a_pos[i] + offset;
+        positions[3 * i + 1] = triangles.b_pos[i] + offset;
+        positions[3 * i + 2] = triangles.c_pos[i] + offset;
+        colors[3 * i] = triangles.a_col[i];
+        colors[3 * i + 1] = triangles.b_col[i];
+        colors[3 * i + 2] = triangles.c_col[i];
+    }
+}
+
+// Corners weld_vertices() moved by more than epsilon, which happens when it merges positions or
+// colors that are distinct. Returns the welded indices for check_cache_order().
+size_t count_weld_errors(const std::vector<glm::vec3>& positions,
+                         const std::vector<glm::vec3>& colors, float epsilon,
+                         std::vector<uint32_t>& indices, size_t& vertex_count) {
+    std::vector<glm::vec3> welded_positions;
+    std::vector<glm::vec3> welded_colors;
+    weld_vertices(positions, colors, epsilon, welded_positions, welded_colors, indices);
+    vertex_count = welded_positions.size();
+    size_t errors = 0;
+    for (size_t i = 0; i < positions.size(); i++) {
+        glm::vec3 moved = glm::abs(welded_positions[indices[i]] - positions[i]);
+        glm::vec3 recolored = glm::abs(welded_colors[indices[i]] - colors[i]);
+        float worst = std::max(std::max(moved.x, std::max(moved.y, moved.z)),
+                               std::max(recolored.x, std::max(recolored.y, recolored.z)));
+        errors += worst > epsilon;
+    }
+    return errors;
+}
+
+// Triangles as sorted corner triples, so lists can be compared whatever order they are drawn in
+void sorted_triangles(const std::vector<uint32_t>& indices,
+                      std::vector<std::pair<uint64_t, uint32_t> >& triangles) {
+    triangles.resize(indices.size() / TRI_VERTEX_COUNT);
+    for (size_t t = 0; t < triangles.size(); t++) {
+        uint32_t corners[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+        std::sort(corners, corners + 3);
+        triangles[t] = std::make_pair((uint64_t)corners[0] << 32 | corners[1], corners[2]);
+    }
+    std::sort(triangles.begin(), triangles.end());
+}
+
+// Whether optimize_vertex_cache() kept every triangle, only changing the order they come in
+bool check_cache_order(const std::vector<uint32_t>& indices, size_t vertex_count) {
+    std::vector<uint32_t> optimized = indices;
+    optimize_vertex_cache(optimized, vertex_count);
+    std::vector<std::pair<uint64_t, uint32_t> > before, after;
+    sorted_triangles(indices, before);
+    sorted_triangles(optimized, after);
+    return before == after;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    config.triangle_count = 100000;
+    config.line_count = 10000;
+    config.shape_count = 0;
+    config.seed = 1;
+    config.update_count = 1000;
+    config.frame_count = 100;
+    config.raster_frame_count = 10;
+    config.cull_view_count = 64;
+    config.raster_width = 640;
+    config.raster_height = 480;
+    config.narrow_test_count = 1000000;
+    config.clearance = 0.05f;
+    config.intersection = default_intersection_config();
+    config.intersection.thread_count = default_thread_count();
+    config.vertex_data = default_vertex_data_config();
+    config.vertex_format = "planar";
+    if (!parse_args(argc, argv, config)) {
+        print_usage();
+        return 1;
+    }
+
+    GeometryStore geometry;
+    MeshData mesh;
+
+    // create_geometry
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    create_bench_geometry(config, geometry);
+    double geometry_seconds = seconds_since(start);
+
+    // mark_intersections, split so the hit count can be reported
+    start = std::chrono::steady_clock::now();
+    HitBuffer hits;
+    query_hits(geometry.triangles, geometry.lines, config.intersection, hits);
+    mark_hits(hits, geometry.triangles, geometry.lines);
+    double intersection_seconds = seconds_since(start);
+    double pair_count = (double)config.triangle_count * config.line_count;
+
+    // triangle_overlaps, through the same broad phase
+    start = std::chrono::steady_clock::now();
+    std::vector<TrianglePair> overlaps;
+    find_triangle_overlaps(geometry.triangles, config.intersection, overlaps);
+    double overlap_seconds = seconds_since(start);
+
+    // line_clearance
+    start = std::chrono::steady_clock::now();
+    std::vector<LinePair> close_lines;
+    find_close_lines(geometry.lines, config.clearance, config.intersection, close_lines);
+    double clearance_seconds = seconds_since(start);
+
+    // create_vertex_data
+    start = std::chrono::steady_clock::now();
+    create_vertex_data(geometry.triangles, geometry.lines, mesh, config.vertex_data);
+    double vertex_seconds = seconds_since(start);
+    size_t input_vertices =
+        config.triangle_count * TRI_VERTEX_COUNT + config.line_count * LINE_VERTEX_COUNT;
+
+    // self_check, welding the scene's corners where it is and moved far from the origin, where
+    // the grid cells outgrow 32 bits. Corners may only merge with ones within the weld distance.
+    const float check_offsets[] = {0.0f, 3000.0f, 1e6f};
+    size_t weld_errors = 0;
+    bool cache_order_kept = true;
+    std::vector<glm::vec3> check_positions;
+    std::vector<glm::vec3> check_colors;
+    std::vector<uint32_t> check_indices;
+    size_t check_vertex_count = 0;
+    for (size_t n = 0; n < sizeof(check_offsets) / sizeof(check_offsets[0]); n++) {
+        scene_corners(geometry.triangles, glm::vec3(check_offsets[n]), check_positions,
+                      check_colors);
+        weld_errors += count_weld_errors(check_positions, check_colors,
+                                         config.vertex_data.weld_epsilon, check_indices,
+                                         check_vertex_count);
+        if (n == 0) {
+            cache_order_kept = check_cache_order(check_indices, check_vertex_count);
+        }
+    }
+    bool checks_passed = weld_errors == 0 && cache_order_kept;
+    if (!checks_passed) {
+        std::cerr << "self check failed: " << weld_errors << " corners welded too far, cache "
+                  << "order " << (cache_order_kept ? "kept" : "lost") << " triangles\n";
+    }
+
+    // instancing, the same marked scene as prototypes plus per-instance offsets and colors
+    start = std::chrono::steady_clock::now();
+    InstancedMesh instanced;
+    create_instanced_mesh(geometry.triangles, geometry.lines, instanced);
+    double instancing_seconds = seconds_since(start);
+    DrawCommandList instanced_commands;
+    build_instanced_draw_commands(instanced, instanced_commands);
+    bool instancing_used =
+        instancing_pays_off(instanced, mesh.vertex_data.size() + index_data_size(mesh));
+
+    // rasterize, the marked scene drawn on the CPU from outside of it
+    Framebuffer framebuffer;
+    resize_framebuffer(framebuffer, config.raster_width, config.raster_height);
+    SoftwareRasterizer rasterizer;
+    float extent = cbrtf((float)config.triangle_count) * 0.5f + 1.0f;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.5f * extent), glm::vec3(0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(
+        glm::radians(45.0f), (float)config.raster_width / config.raster_height, 0.1f, 100.0f);
+    double raster_seconds = 0.0;
+    for (size_t n = 0; n < config.raster_frame_count; n++) {
+        clear_framebuffer(framebuffer, glm::vec3(CLEAR_COLOR));
+        start = std::chrono::steady_clock::now();
+        rasterizer.draw(mesh, projection * view * mesh.layout.dequantize, framebuffer,
+                        config.intersection.thread_count);
+        raster_seconds += seconds_since(start);
+    }
+    double raster_frames = config.raster_frame_count;
+
+    // frustum_culling, on a spatially sorted copy of the scene seen from its center turning around
+    // the Y axis, so most of it is behind or beside the camera
+    GeometryStore sorted;
+    create_bench_geometry(config, sorted);
+    start = std::chrono::steady_clock::now();
+    sort_spatially(sorted.triangles, sorted.lines);
+    double sort_seconds = seconds_since(start);
+    MeshData sorted_mesh;
+    create_vertex_data(sorted.triangles, sorted.lines, sorted_mesh, config.vertex_data);
+    start = std::chrono::steady_clock::now();
+    DrawChunks chunks;
+    build_draw_chunks(sorted_mesh, chunks);
+    double chunk_seconds = seconds_since(start);
+    std::vector<DrawBatch> visible;
+    CullStats cull_stats;
+    glm::mat4 cull_projection = glm::perspective(
+        glm::radians(45.0f), (float)config.raster_width / config.raster_height, 0.1f, 100.0f);
+    size_t chunks_drawn = 0;
+    size_t cull_ranges = 0;
+    size_t multi_draw_calls = 0;
+    DrawCommandList commands;
+    size_t indices_drawn = 0;
+    double cull_seconds = 0.0;
+    for (size_t n = 0; n < config.cull_view_count; n++) {
+        float angle = 2.0f * (float)M_PI * n / config.cull_view_count;
+        glm::vec3 direction(sinf(angle), 0.0f, cosf(angle));
+        glm::mat4 cull_view =
+            glm::lookAt(glm::vec3(0.0f), direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 clip = cull_projection * cull_view * sorted_mesh.layout.dequantize;
+        start = std::chrono::steady_clock::now();
+        cull_chunks(sorted_mesh, chunks, clip, visible, cull_stats);
+        cull_seconds += seconds_since(start);
+        chunks_drawn += cull_stats.drawn;
+        cull_ranges += cull_stats.ranges;
+        build_draw_commands(sorted_mesh, visible, commands);
+        multi_draw_calls += commands.runs.size();
+        for (const auto& batch : visible) {
+            indices_drawn += batch.count;
+        }
+    }
+    size_t index_count = 0;
+    for (const auto& batch : sorted_mesh.batches) {
+        index_count += batch.count;
+    }
+    double cull_views = config.cull_view_count;
+
+    // narrow_phase, the same pairs through intersects(), through intersects_segment() on
+    // precomputed records and through the exact predicates
+    NarrowPhasePairs pairs;
+    make_narrow_phase_pairs(geometry, config.narrow_test_count, config.seed + 2, pairs);
+    size_t legacy_hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < pairs.lines.size(); n++) {
+        legacy_hits += intersects(pairs.lines[n], pairs.triangles[n]);
+    }
+    double legacy_seconds = seconds_since(start);
+    size_t record_hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < pairs.lines.size(); n++) {
+        record_hits +=
+            intersects_segment(pairs.lines[n].a_pos, pairs.lines[n].b_pos, pairs.records[n]);
+    }
+    double record_seconds = seconds_since(start);
+    size_t exact_hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < pairs.lines.size(); n++) {
+        const Triangle& triangle = pairs.triangles[n];
+        exact_hits += intersects_segment_exact(pairs.lines[n].a_pos, pairs.lines[n].b_pos,
+                                               triangle.a_pos, triangle.b_pos, triangle.c_pos);
+    }
+    double exact_seconds = seconds_since(start);
+    double narrow_tests = pairs.lines.size();
+
+    // update_line, on a fresh copy of the scene since the one above is already marked. The
+    // changed vertices are patched into an unwelded mesh so triangles can be recolored alone.
+    GeometryStore edited;
+    MeshData edited_mesh;
+    create_bench_geometry(config, edited);
+    IntersectionState state(edited.triangles, edited.lines);
+    state.build(config.intersection);
+    state.clear_dirty();
+    VertexDataConfig unwelded = config.vertex_data;
+    unwelded.weld = false;
+    create_vertex_data(edited.triangles, edited.lines, edited_mesh, unwelded);
+    DirtyRanges dirty;
+    size_t patched_bytes = 0;
+    size_t rebuild_count = 0;
+    double patch_seconds = 0.0;
+    uint32_t random_state = config.seed + 1;
+    size_t update_count = edited.lines.empty() ? 0 : config.update_count;
+    start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < update_count; n++) {
+        uint32_t i = (uint32_t)(random_float(random_state, 0.0f, 1.0f) * edited.lines.size());
+        i = std::min(i, (uint32_t)edited.lines.size() - 1);
+        glm::vec3 offset = random_vec3(random_state, -0.5f, 0.5f);
+        edited.lines.a_pos[i] += offset;
+        edited.lines.b_pos[i] += offset;
+        state.update_line(i);
+
+        std::chrono::steady_clock::time_point patch_start = std::chrono::steady_clock::now();
+        if (update_vertex_data(edited.triangles, edited.lines, state.dirty_triangles(),
+                               state.dirty_lines(), edited_mesh, dirty)) {
+            coalesce_dirty_ranges(dirty);
+            patched_bytes += dirty_bytes(dirty);
+        } else {
+            create_vertex_data(edited.triangles, edited.lines, edited_mesh, unwelded);
+            patched_bytes += edited_mesh.vertex_data.size();
+            rebuild_count++;
+        }
+        dirty.ranges.clear();
+        state.clear_dirty();
+        patch_seconds += seconds_since(patch_start);
+    }
+    double update_seconds = seconds_since(start) - patch_seconds;
+
+    // sweep_and_prune, animating every line at 60 frames per second and finding the hits of each
+    // frame through the sorted sweep and, to compare, through find_hits() from scratch
+    GeometryStore animated;
+    create_bench_geometry(config, animated);
+    LineStore rest_lines = animated.lines;
+    SweepAndPrune sweep;
+    sweep.build(animated.triangles, animated.lines);
+    std::vector<HitPair> frame_hits;
+    size_t swap_total = 0;
+    size_t candidate_total = 0;
+    size_t sweep_hit_total = 0;
+    double sweep_seconds = 0.0;
+    double rebuild_seconds = 0.0;
+    for (size_t n = 0; n < config.frame_count; n++) {
+        animate_lines(rest_lines, n / 60.0f, animated.lines);
+        start = std::chrono::steady_clock::now();
+        sweep.update(animated.triangles, animated.lines);
+        sweep.find_hits(animated.triangles, animated.lines, config.intersection.narrow_phase,
+                        frame_hits);
+        sweep_seconds += seconds_since(start);
+        swap_total += sweep.swap_count;
+        candidate_total += sweep.candidate_count();
+        sweep_hit_total += frame_hits.size();
+
+        start = std::chrono::steady_clock::now();
+        find_hits(animated.triangles, animated.lines, config.intersection, frame_hits);
+        rebuild_seconds += seconds_since(start);
+    }
+    double frames = config.frame_count;
+
+    std::cout << "{\n"
+              << "  \"scene\": {\"triangles\": " << config.triangle_count
+              << ", \"lines\": " << config.line_count << ", \"shapes\": " << config.shape_count
+              << ", \"seed\": " << config.seed << "},\n"
+              << "  \"config\": {\"mode\": \"" << mode_name(config.intersection.mode)
+              << "\", \"narrow_phase\": \""
+              << narrow_phase_name(config.intersection.narrow_phase)
+              << "\", \"threads\": " << config.intersection.thread_count << ", \"simd\": \""
+              << simd_level_name(simd_level) << "\", \"vertex_format\": \""
+              << config.vertex_format << "\", \"weld\": "
+              << (config.vertex_data.weld ? "true" : "false") << "},\n"
+              << "  \"stages\": {\n"
+              << "    \"create_geometry\": {\"seconds\": " << geometry_seconds
+              << ", \"primitives_per_second\": "
+              << rate(config.triangle_count + config.line_count, geometry_seconds) << "},\n"
+              << "    \"mark_intersections\": {\"seconds\": " << intersection_seconds
+              << ", \"hits\": " << hits.hits.size()
+              << ", \"pairs_per_second\": " << rate(pair_count, intersection_seconds) << "},\n"
+              << "    \"triangle_overlaps\": {\"seconds\": " << overlap_seconds
+              << ", \"pairs\": " << overlaps.size() << ", \"triangles_per_second\": "
+              << rate(config.triangle_count, overlap_seconds) << "},\n"
+              << "    \"line_clearance\": {\"seconds\": " << clearance_seconds
+              << ", \"clearance\": " << config.clearance << ", \"pairs\": " << close_lines.size()
+              << ", \"lines_per_second\": " << rate(config.line_count, clearance_seconds)
+              << "},\n"
+              << "    \"create_vertex_data\": {\"seconds\": " << vertex_seconds
+              << ", \"vertices\": " << mesh.vertex_count
+              << ", \"vertices_per_second\": " << rate(input_vertices, vertex_seconds)
+              << ", \"bytes\": " << mesh.vertex_data.size() + index_data_size(mesh)
+              << ", \"acmr_before\": " << mesh.stats.acmr_before
+              << ", \"acmr_after\": " << mesh.stats.acmr_after
+              << ", \"draw_calls\": " << mesh.batches.size() << "},\n"
+              << "    \"self_check\": {\"passed\": " << (checks_passed ? "true" : "false")
+              << ", \"weld_offsets\": " << sizeof(check_offsets) / sizeof(check_offsets[0])
+              << ", \"weld_errors\": " << weld_errors << ", \"cache_order_kept\": "
+              << (cache_order_kept ? "true" : "false") << "},\n"
+              << "    \"instancing\": {\"seconds\": " << instancing_seconds
+              << ", \"prototypes\": " << instanced.batches.size()
+              << ", \"instances\": " << instanced.instances.size()
+              << ", \"bytes\": " << instanced_mesh_bytes(instanced)
+              << ", \"indirect_draw_calls\": " << instanced_commands.runs.size()
+              << ", \"pays_off\": " << (instancing_used ? "true" : "false") << "},\n"
+              << "    \"rasterize\": {\"frames\": " << config.raster_frame_count
+              << ", \"width\": " << config.raster_width << ", \"height\": "
+              << config.raster_height << ", \"ms_per_frame\": "
+              << (raster_frames ? raster_seconds * 1e3 / raster_frames : 0.0)
+              << ", \"primitives_drawn\": " << rasterizer.stats.primitives_out
+              << ", \"tiles\": " << rasterizer.stats.tile_count
+              << ", \"binned\": " << rasterizer.stats.binned << "},\n"
+              << "    \"frustum_culling\": {\"views\": " << config.cull_view_count
+              << ", \"sort_seconds\": " << sort_seconds << ", \"chunk_seconds\": " << chunk_seconds
+              << ", \"chunks\": " << chunks.chunks.size() << ", \"microseconds_per_view\": "
+              << (cull_views ? cull_seconds * 1e6 / cull_views : 0.0)
+              << ", \"chunks_drawn_per_view\": " << (cull_views ? chunks_drawn / cull_views : 0.0)
+              << ", \"ranges_per_view\": " << (cull_views ? cull_ranges / cull_views : 0.0)
+              << ", \"multi_draw_calls_per_view\": "
+              << (cull_views ? multi_draw_calls / cull_views : 0.0) << ", \"fraction_drawn\": "
+              << (cull_views && index_count ? indices_drawn / cull_views / index_count : 0.0)
+              << "},\n"
+              << "    \"narrow_phase\": {\"tests\": " << pairs.lines.size()
+              << ", \"intersects_ns_per_test\": "
+              << nanoseconds_per_item(legacy_seconds, narrow_tests)
+              << ", \"intersects_hits\": " << legacy_hits
+              << ", \"record_ns_per_test\": "
+              << nanoseconds_per_item(record_seconds, narrow_tests)
+              << ", \"record_hits\": " << record_hits << ", \"exact_ns_per_test\": "
+              << nanoseconds_per_item(exact_seconds, narrow_tests)
+              << ", \"exact_hits\": " << exact_hits << "},\n"
+              << "    \"update_line\": {\"seconds\": " << update_seconds
+              << ", \"updates\": " << update_count
+              << ", \"microseconds_per_update\": "
+              << (update_count ? update_seconds * 1e6 / update_count : 0.0) << "},\n"
+              << "    \"update_vertex_data\": {\"seconds\": " << patch_seconds
+              << ", \"bytes_patched\": " << patched_bytes
+              << ", \"bytes_full_upload\": " << update_count * edited_mesh.vertex_data.size()
+              << ", \"rebuilds\": " << rebuild_count << "},\n"
+              << "    \"sweep_and_prune\": {\"frames\": " << config.frame_count
+              << ", \"ms_per_frame\": " << (frames ? sweep_seconds * 1e3 / frames : 0.0)
+              << ", \"find_hits_ms_per_frame\": "
+              << (frames ? rebuild_seconds * 1e3 / frames : 0.0)
+              << ", \"swaps_per_frame\": " << (frames ? swap_total / frames : 0.0)
+              << ", \"candidates_per_frame\": " << (frames ? candidate_total / frames : 0.0)
+              << ", \"hits_per_frame\": " << (frames ? sweep_hit_total / frames : 0.0) << "}\n"
+              << "  },\n"
+              << "  \"peak_rss_bytes\": " << peak_rss_bytes() << "\n"
+              << "}" << std::endl;
+    return checks_passed ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+#include "../include/glm/glm.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#ifndef bvh_hpp
+#define bvh_hpp
+
+// Build parameters
+const int BVH_BIN_COUNT = 16;
+const int BVH_MAX_LEAF_SIZE = 8;
+const int BVH_MAX_DEPTH = 60; // keeps the fixed size traversal stacks below from overflowing
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECTION_COST = 1.0f;
+
+// Boxes are padded so the tolerance used by the narrow phase never lets a hit fall outside of them
+const float AABB_PADDING = 1e-5f;
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+AABB empty_aabb() {
+    return (AABB){.min = glm::vec3(INFINITY), .max = glm::vec3(-INFINITY)};
+}
+
+void grow(AABB& box, const glm::vec3& p) {
+    box.min = glm::min(box.min, p);
+    box.max = glm::max(box.max, p);
+}
+
+void grow(AABB& box, const AABB& other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+void pad(AABB& box) {
+    glm::vec3 magnitude = glm::max(glm::abs(box.min), glm::abs(box.max));
+    float largest = glm::max(magnitude.x, glm::max(magnitude.y, magnitude.z));
+    float padding = AABB_PADDING * (1.0f + largest);
+    box.min -= glm::vec3(padding);
+    box.max += glm::vec3(padding);
+}
+
+float surface_area(const AABB& box) {
+    glm::vec3 e = box.max - box.min;
+    if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+glm::vec3 centroid(const AABB& box) {
+    return (box.min + box.max) * 0.5f;
+}
+
+bool overlaps(const AABB& a, const AABB& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Slab test of the segment a + (b - a) * t for t in [0, 1] against a box
+bool overlaps_segment(const AABB& box, const glm::vec3& a, const glm::vec3& b) {
+    glm::vec3 d = b - a;
+    float t_min = 0.0f;
+    float t_max = 1.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        if (d[axis] == 0.0f) {
+            // Parallel to the slab so the origin has to be inside of it
+            if (a[axis] < box.min[axis] || a[axis] > box.max[axis]) {
+                return false;
+            }
+            continue;
+        }
+        float inv_d = 1.0f / d[axis];
+        float t0 = (box.min[axis] - a[axis]) * inv_d;
+        float t1 = (box.max[axis] - a[axis]) * inv_d;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        t_min = std::max(t_min, t0);
+        t_max = std::min(t_max, t1);
+        if (t_min > t_max) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Interior nodes store the index of their left child (the right child follows it) and leaves
+// store the first entry of their primitive range in BVH::indices
+struct BVHNode {
+    AABB bounds;
+    uint32_t left_first;
+    uint32_t count;
+};
+
+// Bounding volume hierarchy over a set of primitive boxes built with the binned surface area
+// heuristic. Queries report leaves as [first, first + count) ranges into indices. Rebuilding keeps
+// the storage of the previous build.
+class BVH {
+  public:
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> indices;
+
+    void build(const std::vector<AABB>& boxes) {
+        nodes.clear();
+        indices.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            indices[i] = i;
+        }
+        if (boxes.empty()) {
+            return;
+        }
+
+        centroids.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            centroids[i] = centroid(boxes[i]);
+        }
+
+        nodes.reserve(2 * boxes.size());
+        nodes.push_back((BVHNode){.bounds = empty_aabb(), .left_first = 0,
+                                  .count = (uint32_t)boxes.size()});
+
+        build_stack.clear();
+        build_stack.push_back(std::make_pair(0u, 0));
+        while (!build_stack.empty()) {
+            uint32_t node_index = build_stack.back().first;
+            int depth = build_stack.back().second;
+            build_stack.pop_back();
+
+            BVHNode& node = nodes[node_index];
+            AABB centroid_bounds = empty_aabb();
+            for (uint32_t i = node.left_first; i < node.left_first + node.count; i++) {
+                grow(node.bounds, boxes[indices[i]]);
+                grow(centroid_bounds, centroids[indices[i]]);
+            }
+
+            uint32_t mid;
+            if (depth >= BVH_MAX_DEPTH || !split(node, centroid_bounds, boxes, mid)) {
+                continue;
+            }
+
+            // Children are allocated in pairs so only the left index has to be stored
+            uint32_t first = node.left_first;
+            uint32_t count = node.count;
+            uint32_t left_index = nodes.size();
+            node.left_first = left_index;
+            node.count = 0;
+            nodes.push_back((BVHNode){.bounds = empty_aabb(), .left_first = first,
+                                      .count = mid - first});
+            nodes.push_back((BVHNode){.bounds = empty_aabb(), .left_first = mid,
+                                      .count = first + count - mid});
+            build_stack.push_back(std::make_pair(left_index + 1, depth + 1));
+            build_stack.push_back(std::make_pair(left_index, depth + 1));
+        }
+    }
+
+    // Calls visit(first, count) for every leaf whose box the segment from a to b passes through
+    template <typename Visitor>
+    void query_segment(const glm::vec3& a, const glm::vec3& b, Visitor visit) const {
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const BVHNode& node = nodes[stack[--stack_size]];
+            if (!overlaps_segment(node.bounds, a, b)) {
+                continue;
+            }
+            if (node.count > 0) {
+                visit(node.left_first, node.count);
+            } else {
+                stack[stack_size++] = node.left_first + 1;
+                stack[stack_size++] = node.left_first;
+            }
+        }
+    }
+
+    // Calls visit(first, count) for every leaf whose box overlaps the given box
+    template <typename Visitor> void query_box(const AABB& box, Visitor visit) const {
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const BVHNode& node = nodes[stack[--stack_size]];
+            if (!overlaps(node.bounds, box)) {
+                continue;
+            }
+            if (node.count > 0) {
+                visit(node.left_first, node.count);
+            } else {
+                stack[stack_size++] = node.left_first + 1;
+                stack[stack_size++] = node.left_first;
+            }
+        }
+    }
+
+  private:
+    // Build scratch: primitive centroids and pairs of node index and depth still to split
+    std::vector<glm::vec3> centroids;
+    std::vector<std::pair<uint32_t, int> > build_stack;
+
+    struct Bin {
+        AABB bounds;
+        uint32_t count;
+    };
+
+    // Finds the cheapest binned SAH split of a node and partitions its primitive range around it.
+    // Returns false when the node should stay a leaf.
+    bool split(const BVHNode& node, const AABB& centroid_bounds, const std::vector<AABB>& boxes,
+               uint32_t& mid) {
+        if (node.count <= 1) {
+            return false;
+        }
+
+        float best_cost = INFINITY;
+        int best_axis = -1;
+        int best_bin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centroid_bounds.min[axis];
+            float hi = centroid_bounds.max[axis];
+            if (hi <= lo) {
+                continue;
+            }
+
+            Bin bins[BVH_BIN_COUNT];
+            for (int i = 0; i < BVH_BIN_COUNT; i++) {
+                bins[i].bounds = empty_aabb();
+                bins[i].count = 0;
+            }
+            float scale = BVH_BIN_COUNT / (hi - lo);
+            for (uint32_t i = node.left_first; i < node.left_first + node.count; i++) {
+                int bin = bin_index(centroids[indices[i]][axis], lo, scale);
+                bins[bin].count++;
+                grow(bins[bin].bounds, boxes[indices[i]]);
+            }
+
+            // Sweep from the right to get the area and count of every right hand side
+            float right_area[BVH_BIN_COUNT];
+            uint32_t right_count[BVH_BIN_COUNT];
+            AABB right_bounds = empty_aabb();
+            uint32_t count = 0;
+            for (int i = BVH_BIN_COUNT - 1; i > 0; i--) {
+                grow(right_bounds, bins[i].bounds);
+                count += bins[i].count;
+                right_area[i] = surface_area(right_bounds);
+                right_count[i] = count;
+            }
+
+            AABB left_bounds = empty_aabb();
+            count = 0;
+            for (int i = 0; i < BVH_BIN_COUNT - 1; i++) {
+                grow(left_bounds, bins[i].bounds);
+                count += bins[i].count;
+                if (count == 0 || right_count[i + 1] == 0) {
+                    continue;
+                }
+                float cost = count * surface_area(left_bounds) +
+                             right_count[i + 1] * right_area[i + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = i;
+                }
+            }
+        }
+
+        if (best_axis < 0) {
+            return false;
+        }
+
+        float node_area = surface_area(node.bounds);
+        float leaf_cost = BVH_INTERSECTION_COST * node.count;
+        float split_cost = BVH_TRAVERSAL_COST;
+        if (node_area > 0.0f) {
+            split_cost += BVH_INTERSECTION_COST * best_cost / node_area;
+        }
+        if (node.count <= (uint32_t)BVH_MAX_LEAF_SIZE && split_cost >= leaf_cost) {
+            return false;
+        }
+
+        float lo = centroid_bounds.min[best_axis];
+        float scale = BVH_BIN_COUNT / (centroid_bounds.max[best_axis] - lo);
+        uint32_t* first = &indices[node.left_first];
+        uint32_t* last = first + node.count;
+        uint32_t* middle = std::partition(first, last, [&](uint32_t i) {
+            return bin_index(centroids[i][best_axis], lo, scale) <= best_bin;
+        });
+        mid = node.left_first + (middle - first);
+        return true;
+    }
+
+    static int bin_index(float value, float lo, float scale) {
+        int bin = (int)((value - lo) * scale);
+        return std::min(std::max(bin, 0), BVH_BIN_COUNT - 1);
+    }
+};
+
+#endif
@@ -23,4 +23,8 @@ const int COL_ELEM_COUNT = 3;
 const unsigned int SCR_WIDTH = 400;
 const unsigned int SCR_HEIGHT = 400;
 
+// Camera
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 100.0f;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "../include/glm/glm.hpp"
+#include "bvh.hpp"
+#include "geometry.hpp"
+#include "simd.hpp"
+#include "vertex_data.hpp"
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#ifndef culling_hpp
+#define culling_hpp
+
+// Primitives per culling chunk. Chunks have to be small next to the scene to be culled at all, and
+// large enough that testing them costs nothing next to drawing them.
+const size_t DRAW_CHUNK_PRIMITIVES = 512;
+
+// Bits per axis of the Morton codes primitives are sorted by
+const int MORTON_BITS = 10;
+
+// Spreads the low 10 bits of v out so two zero bits follow each of them
+uint32_t spread_bits(uint32_t v) {
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Position along a Z-order curve through the bounds, so nearby points get nearby codes
+uint32_t morton_code(const glm::vec3& p, const AABB& bounds) {
+    glm::vec3 size = glm::max(bounds.max - bounds.min, glm::vec3(1e-20f));
+    glm::vec3 cell = (p - bounds.min) / size * (float)(1 << MORTON_BITS);
+    uint32_t x = (uint32_t)glm::clamp(cell.x, 0.0f, (float)((1 << MORTON_BITS) - 1));
+    uint32_t y = (uint32_t)glm::clamp(cell.y, 0.0f, (float)((1 << MORTON_BITS) - 1));
+    uint32_t z = (uint32_t)glm::clamp(cell.z, 0.0f, (float)((1 << MORTON_BITS) - 1));
+    return spread_bits(x) << 2 | spread_bits(y) << 1 | spread_bits(z);
+}
+
+// Order of the given centers along the Z-order curve, ties kept in input order
+void morton_order(const std::vector<glm::vec3>& centers, std::vector<uint32_t>& order) {
+    AABB bounds = empty_aabb();
+    for (const auto& c : centers) {
+        grow(bounds, c);
+    }
+    std::vector<std::pair<uint32_t, uint32_t> > keys(centers.size());
+    for (size_t i = 0; i < centers.size(); i++) {
+        keys[i] = std::make_pair(morton_code(centers[i], bounds), (uint32_t)i);
+    }
+    std::sort(keys.begin(), keys.end());
+    order.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        order[i] = keys[i].second;
+    }
+}
+
+// Reorders triangles and lines so neighbours in the stores are neighbours in space, which makes
+// every run of primitives drawn together a compact chunk. Anything holding primitive indices has
+// to be built after this.
+void sort_spatially(TriangleStore& triangles, LineStore& lines) {
+    std::vector<glm::vec3> centers(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        centers[i] = (triangles.a_pos[i] + triangles.b_pos[i] + triangles.c_pos[i]) / 3.0f;
+    }
+    std::vector<uint32_t> order;
+    morton_order(centers, order);
+    TriangleStore sorted_triangles;
+    sorted_triangles.reserve(triangles.size());
+    for (auto i : order) {
+        sorted_triangles.push_back(triangles[i]);
+    }
+    triangles = sorted_triangles;
+
+    centers.resize(lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        centers[i] = (lines.a_pos[i] + lines.b_pos[i]) * 0.5f;
+    }
+    morton_order(centers, order);
+    LineStore sorted_lines;
+    sorted_lines.reserve(lines.size());
+    for (auto i : order) {
+        sorted_lines.push_back(lines[i]);
+    }
+    lines = sorted_lines;
+}
+
+// Indices [first, first + count) of mesh batch number batch, in the units of DrawBatch::first
+struct DrawChunk {
+    uint32_t batch;
+    size_t first;
+    size_t count;
+};
+
+// Chunks of every batch of a mesh and their bounds in the mesh's own position space (before
+// dequantize). Bounds are stored as structure-of-arrays padded like PackedTriangles so a packet of
+// chunks can be tested at once.
+struct DrawChunks {
+    std::vector<DrawChunk> chunks;
+    FloatArray min_x, min_y, min_z;
+    FloatArray max_x, max_y, max_z;
+};
+
+// Bounds of the vertices a chunk draws, in mesh space
+AABB chunk_bounds(const MeshData& mesh, const DrawChunk& chunk) {
+    const DrawBatch& batch = mesh.batches[chunk.batch];
+    AABB box = empty_aabb();
+    for (size_t i = chunk.first - batch.first; i < chunk.first - batch.first + chunk.count; i++) {
+        grow(box, read_position(mesh, batch_vertex(mesh, batch, i)));
+    }
+    return box;
+}
+
+void set_chunk_bounds(DrawChunks& chunks, size_t i, const AABB& box) {
+    chunks.min_x[i] = box.min.x;
+    chunks.min_y[i] = box.min.y;
+    chunks.min_z[i] = box.min.z;
+    chunks.max_x[i] = box.max.x;
+    chunks.max_y[i] = box.max.y;
+    chunks.max_z[i] = box.max.z;
+}
+
+// Splits every batch into chunks of chunk_primitives primitives and bounds them. Has to be run
+// again whenever the mesh is rebuilt, see refresh_draw_chunks() for vertices patched in place.
+void build_draw_chunks(const MeshData& mesh, DrawChunks& chunks,
+                       size_t chunk_primitives = DRAW_CHUNK_PRIMITIVES) {
+    chunks.chunks.clear();
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const DrawBatch& batch = mesh.batches[b];
+        size_t chunk_indices =
+            chunk_primitives *
+            (batch.primitive == PrimitiveType::TRIANGLES ? TRI_VERTEX_COUNT : LINE_VERTEX_COUNT);
+        for (size_t k = 0; k < batch.count; k += chunk_indices) {
+            DrawChunk chunk;
+            chunk.batch = b;
+            chunk.first = batch.first + k;
+            chunk.count = std::min(chunk_indices, batch.count - k);
+            chunks.chunks.push_back(chunk);
+        }
+    }
+
+    size_t padded = (chunks.chunks.size() + SIMD_MAX_WIDTH - 1) / SIMD_MAX_WIDTH * SIMD_MAX_WIDTH;
+    FloatArray* arrays[6] = {&chunks.min_x, &chunks.min_y, &chunks.min_z,
+                             &chunks.max_x, &chunks.max_y, &chunks.max_z};
+    for (auto array : arrays) {
+        array->assign(padded, 0.0f);
+    }
+    for (size_t i = 0; i < chunks.chunks.size(); i++) {
+        set_chunk_bounds(chunks, i, chunk_bounds(mesh, chunks.chunks[i]));
+    }
+}
+
+// Bounds the chunks of one kind of primitive again after their vertices moved in place. Animated
+// lines only need their own chunks redone, not the triangles around them.
+void refresh_draw_chunks(const MeshData& mesh, DrawChunks& chunks, PrimitiveType primitive) {
+    for (size_t i = 0; i < chunks.chunks.size(); i++) {
+        if (mesh.batches[chunks.chunks[i].batch].primitive == primitive) {
+            set_chunk_bounds(chunks, i, chunk_bounds(mesh, chunks.chunks[i]));
+        }
+    }
+}
+
+struct FrustumPlanes {
+    glm::vec4 planes[6];
+};
+
+// Gribb and Hartmann's extraction from a clip matrix. With projection * view * model the planes
+// come out in model space.
+FrustumPlanes extract_frustum_planes(const glm::mat4& clip) {
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+    }
+    FrustumPlanes frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[2 * axis] = rows[3] + rows[axis];
+        frustum.planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+    return frustum;
+}
+
+// The corner of each box furthest along a plane normal decides whether the box is outside that
+// plane, so the kernels read the min or max array per axis instead of picking per lane. Boxes
+// outside the frustum near one of its edges but inside every plane are kept, which only costs a
+// draw.
+struct CullPlane {
+    const float* x;
+    const float* y;
+    const float* z;
+    glm::vec4 plane;
+};
+
+void make_cull_planes(const FrustumPlanes& frustum, const DrawChunks& chunks, CullPlane* planes) {
+    for (int p = 0; p < 6; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+        planes[p].x = plane.x >= 0.0f ? chunks.max_x.data() : chunks.min_x.data();
+        planes[p].y = plane.y >= 0.0f ? chunks.max_y.data() : chunks.min_y.data();
+        planes[p].z = plane.z >= 0.0f ? chunks.max_z.data() : chunks.min_z.data();
+        planes[p].plane = plane;
+    }
+}
+
+// Bitmask of the SIMD_MAX_WIDTH chunks starting at first that are inside every plane. Lanes past
+// the last chunk have to be masked out by the caller.
+uint32_t cull_packet_scalar(const CullPlane* planes, size_t first) {
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < SIMD_MAX_WIDTH; lane++) {
+        size_t i = first + lane;
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            const CullPlane& c = planes[p];
+            float distance =
+                c.plane.x * c.x[i] + c.plane.y * c.y[i] + c.plane.z * c.z[i] + c.plane.w;
+            inside = inside && distance >= 0.0f;
+        }
+        if (inside) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#ifdef SIMD_X86
+
+uint32_t cull_packet_sse(const CullPlane* planes, size_t first) {
+    uint32_t mask = 0;
+    for (size_t offset = 0; offset < SIMD_MAX_WIDTH; offset += 4) {
+        size_t i = first + offset;
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            const CullPlane& c = planes[p];
+            __m128 dx = _mm_mul_ps(_mm_set1_ps(c.plane.x), _mm_load_ps(c.x + i));
+            __m128 dy = _mm_mul_ps(_mm_set1_ps(c.plane.y), _mm_load_ps(c.y + i));
+            __m128 dz = _mm_mul_ps(_mm_set1_ps(c.plane.z), _mm_load_ps(c.z + i));
+            __m128 distance =
+                _mm_add_ps(_mm_add_ps(_mm_add_ps(dx, dy), dz), _mm_set1_ps(c.plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        mask |= (uint32_t)_mm_movemask_ps(inside) << offset;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) uint32_t cull_packet_avx2(const CullPlane* planes, size_t first) {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+        const CullPlane& c = planes[p];
+        __m256 dx = _mm256_mul_ps(_mm256_set1_ps(c.plane.x), _mm256_load_ps(c.x + first));
+        __m256 dy = _mm256_mul_ps(_mm256_set1_ps(c.plane.y), _mm256_load_ps(c.y + first));
+        __m256 dz = _mm256_mul_ps(_mm256_set1_ps(c.plane.z), _mm256_load_ps(c.z + first));
+        __m256 distance =
+            _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(dx, dy), dz), _mm256_set1_ps(c.plane.w));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    return (uint32_t)_mm256_movemask_ps(inside);
+}
+
+#endif
+
+uint32_t cull_packet(const CullPlane* planes, size_t first) {
+#ifdef SIMD_X86
+    if (simd_level == SimdLevel::AVX2) {
+        return cull_packet_avx2(planes, first);
+    }
+    if (simd_level == SimdLevel::SSE) {
+        return cull_packet_sse(planes, first);
+    }
+#endif
+    return cull_packet_scalar(planes, first);
+}
+
+// What the last cull_chunks() kept
+struct CullStats {
+    size_t chunk_count;
+    size_t culled;
+    size_t drawn;
+    size_t ranges; // index ranges left after merging neighbouring chunks
+};
+
+// Collects the batches covering the chunks inside the frustum of clip (projection * view * model).
+// Runs of visible chunks next to each other in one batch are merged into one range.
+void cull_chunks(const MeshData& mesh, const DrawChunks& chunks, const glm::mat4& clip,
+                 std::vector<DrawBatch>& visible, CullStats& stats) {
+    CullPlane planes[6];
+    make_cull_planes(extract_frustum_planes(clip), chunks, planes);
+    visible.clear();
+    stats.chunk_count = chunks.chunks.size();
+    stats.drawn = 0;
+    const DrawChunk* last = NULL;
+    for (size_t first = 0; first < chunks.chunks.size(); first += SIMD_MAX_WIDTH) {
+        uint32_t mask = cull_packet(planes, first);
+        size_t lanes = std::min(SIMD_MAX_WIDTH, chunks.chunks.size() - first);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (!(mask >> lane & 1)) {
+                continue;
+            }
+            const DrawChunk& chunk = chunks.chunks[first + lane];
+            if (last != NULL && last->batch == chunk.batch &&
+                visible.back().first + visible.back().count == chunk.first) {
+                visible.back().count += chunk.count;
+            } else {
+                visible.push_back(mesh.batches[chunk.batch]);
+                visible.back().first = chunk.first;
+                visible.back().count = chunk.count;
+            }
+            last = &chunk;
+            stats.drawn++;
+        }
+    }
+    stats.culled = stats.chunk_count - stats.drawn;
+    stats.ranges = visible.size();
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "vertex_data.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef draw_commands_hpp
+#define draw_commands_hpp
+
+// One indexed draw in the layout of OpenGL's DrawElementsIndirectCommand, so the commands can be
+// copied into an indirect buffer as they are. first_index counts indices of the run's type from
+// the start of the index buffer.
+struct DrawCommand {
+    uint32_t count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+};
+
+// Commands [first, first + count) that share a primitive and index type, so one multi-draw call
+// can submit all of them
+struct DrawCommandRun {
+    PrimitiveType primitive;
+    IndexType index_type;
+    size_t first;
+    size_t count;
+};
+
+// The draws of one frame. The same commands are also kept as the separate arrays
+// glMultiDrawElementsBaseVertex takes, with index offsets in bytes.
+struct DrawCommandList {
+    std::vector<DrawCommand> commands;
+    std::vector<DrawCommandRun> runs;
+    std::vector<int32_t> counts;
+    std::vector<const void*> offsets;
+    std::vector<int32_t> base_vertices;
+};
+
+void clear_draw_commands(DrawCommandList& list) {
+    list.commands.clear();
+    list.runs.clear();
+    list.counts.clear();
+    list.offsets.clear();
+    list.base_vertices.clear();
+}
+
+// Appends one command, starting a new run unless the last one has the same primitive and index
+// type. byte_offset is where its first index is in the index buffer.
+void add_draw_command(DrawCommandList& list, PrimitiveType primitive, IndexType index_type,
+                      size_t count, size_t byte_offset, int32_t base_vertex,
+                      uint32_t instance_count = 1, uint32_t base_instance = 0) {
+    DrawCommand command;
+    command.count = count;
+    command.instance_count = instance_count;
+    command.first_index = byte_offset / index_size(index_type);
+    command.base_vertex = base_vertex;
+    command.base_instance = base_instance;
+
+    if (list.runs.empty() || list.runs.back().primitive != primitive ||
+        list.runs.back().index_type != index_type) {
+        DrawCommandRun run;
+        run.primitive = primitive;
+        run.index_type = index_type;
+        run.first = list.commands.size();
+        run.count = 0;
+        list.runs.push_back(run);
+    }
+    list.runs.back().count++;
+    list.commands.push_back(command);
+    list.counts.push_back(count);
+    list.offsets.push_back((const void*)byte_offset);
+    list.base_vertices.push_back(base_vertex);
+}
+
+// Turns batches of the mesh into commands, keeping their order. Batches next to each other with
+// the same primitive and index type end up in one run.
+void build_draw_commands(const MeshData& mesh, const std::vector<DrawBatch>& batches,
+                         DrawCommandList& list) {
+    clear_draw_commands(list);
+    for (const auto& batch : batches) {
+        add_draw_command(list, batch.primitive, batch.index_type, batch.count,
+                         index_byte_offset(mesh, batch), batch.base_vertex);
+    }
+}
+
+#endif
@@ -1,4 +1,8 @@
 #include "../include/glm/glm.hpp"
+#include "simd.hpp"
+
+#include <stddef.h>
+#include <vector>
 
 #ifndef geometry_hpp
 #define geometry_hpp
@@ -19,8 +23,212 @@ struct Line {
     glm::vec3 b_col;
 };
 
+typedef std::vector<glm::vec3, AlignedAllocator<glm::vec3> > Vec3Array;
+
+// Views of one element of a store. They can be read and written like a Triangle or Line and
+// convert to one by value.
+struct TriangleRef {
+    glm::vec3& a_pos;
+    glm::vec3& b_pos;
+    glm::vec3& c_pos;
+    glm::vec3& a_col;
+    glm::vec3& b_col;
+    glm::vec3& c_col;
+
+    operator Triangle() const {
+        return (Triangle){.a_pos = a_pos, .b_pos = b_pos, .c_pos = c_pos,
+                          .a_col = a_col, .b_col = b_col, .c_col = c_col};
+    }
+
+    const TriangleRef& operator=(const Triangle& triangle) const {
+        a_pos = triangle.a_pos;
+        b_pos = triangle.b_pos;
+        c_pos = triangle.c_pos;
+        a_col = triangle.a_col;
+        b_col = triangle.b_col;
+        c_col = triangle.c_col;
+        return *this;
+    }
+};
+
+struct LineRef {
+    glm::vec3& a_pos;
+    glm::vec3& b_pos;
+    glm::vec3& a_col;
+    glm::vec3& b_col;
+
+    operator Line() const {
+        return (Line){.a_pos = a_pos, .b_pos = b_pos, .a_col = a_col, .b_col = b_col};
+    }
+
+    const LineRef& operator=(const Line& line) const {
+        a_pos = line.a_pos;
+        b_pos = line.b_pos;
+        a_col = line.a_col;
+        b_col = line.b_col;
+        return *this;
+    }
+};
+
+// Iterator over a store that hands out views, enough for range based for loops
+template <typename Store, typename Ref> class StoreIterator {
+  public:
+    StoreIterator(Store* store, size_t index) : store(store), index(index) {}
+
+    Ref operator*() const {
+        return (*store)[index];
+    }
+
+    StoreIterator& operator++() {
+        index++;
+        return *this;
+    }
+
+    bool operator!=(const StoreIterator& other) const {
+        return index != other.index;
+    }
+
+  private:
+    Store* store;
+    size_t index;
+};
+
+// Triangles stored as one contiguous aligned array per corner position and per corner color, so
+// passes that only need positions never touch colors
+class TriangleStore {
+  public:
+    typedef StoreIterator<TriangleStore, TriangleRef> iterator;
+
+    Vec3Array a_pos, b_pos, c_pos;
+    Vec3Array a_col, b_col, c_col;
+
+    size_t size() const {
+        return a_pos.size();
+    }
+
+    bool empty() const {
+        return a_pos.empty();
+    }
+
+    void reserve(size_t count) {
+        for (auto array : arrays()) {
+            array->reserve(count);
+        }
+    }
+
+    void resize(size_t count) {
+        for (auto array : arrays()) {
+            array->resize(count);
+        }
+    }
+
+    void clear() {
+        resize(0);
+    }
+
+    void push_back(const Triangle& triangle) {
+        a_pos.push_back(triangle.a_pos);
+        b_pos.push_back(triangle.b_pos);
+        c_pos.push_back(triangle.c_pos);
+        a_col.push_back(triangle.a_col);
+        b_col.push_back(triangle.b_col);
+        c_col.push_back(triangle.c_col);
+    }
+
+    TriangleRef operator[](size_t i) {
+        TriangleRef ref = {a_pos[i], b_pos[i], c_pos[i], a_col[i], b_col[i], c_col[i]};
+        return ref;
+    }
+
+    Triangle operator[](size_t i) const {
+        return (Triangle){.a_pos = a_pos[i], .b_pos = b_pos[i], .c_pos = c_pos[i],
+                          .a_col = a_col[i], .b_col = b_col[i], .c_col = c_col[i]};
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, size());
+    }
+
+  private:
+    std::vector<Vec3Array*> arrays() {
+        Vec3Array* all[] = {&a_pos, &b_pos, &c_pos, &a_col, &b_col, &c_col};
+        return std::vector<Vec3Array*>(all, all + 6);
+    }
+};
+
+class LineStore {
+  public:
+    typedef StoreIterator<LineStore, LineRef> iterator;
+
+    Vec3Array a_pos, b_pos;
+    Vec3Array a_col, b_col;
+
+    size_t size() const {
+        return a_pos.size();
+    }
+
+    bool empty() const {
+        return a_pos.empty();
+    }
+
+    void reserve(size_t count) {
+        for (auto array : arrays()) {
+            array->reserve(count);
+        }
+    }
+
+    void resize(size_t count) {
+        for (auto array : arrays()) {
+            array->resize(count);
+        }
+    }
+
+    void clear() {
+        resize(0);
+    }
+
+    void push_back(const Line& line) {
+        a_pos.push_back(line.a_pos);
+        b_pos.push_back(line.b_pos);
+        a_col.push_back(line.a_col);
+        b_col.push_back(line.b_col);
+    }
+
+    LineRef operator[](size_t i) {
+        LineRef ref = {a_pos[i], b_pos[i], a_col[i], b_col[i]};
+        return ref;
+    }
+
+    Line operator[](size_t i) const {
+        return (Line){.a_pos = a_pos[i], .b_pos = b_pos[i], .a_col = a_col[i], .b_col = b_col[i]};
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, size());
+    }
+
+  private:
+    std::vector<Vec3Array*> arrays() {
+        Vec3Array* all[] = {&a_pos, &b_pos, &a_col, &b_col};
+        return std::vector<Vec3Array*>(all, all + 4);
+    }
+};
+
+struct GeometryStore {
+    TriangleStore triangles;
+    LineStore lines;
+};
+
 bool is_left(glm::vec2 a, glm::vec2 b, glm::vec2 c) {
     return ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x)) > 0;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,300 @@
+#include "../include/glm/glm.hpp"
+#include "constants.hpp"
+#include "draw_commands.hpp"
+#include "geometry.hpp"
+#include "mesh_optimizer.hpp"
+#include "vertex_data.hpp"
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef instancing_hpp
+#define instancing_hpp
+
+// Spacing of the grid shapes are snapped to when looking for copies of one shape, and how far a
+// moved primitive may drift from its prototype. Coarser than WELD_EPSILON so lines moved around by
+// float math in large scenes still fit the prototype they started with.
+const float INSTANCE_EPSILON = 1e-4f;
+
+// Instances each prototype has to be drawn for on average before instancing is worth it. Below
+// that the instances and extra draw calls cost more than the packed mesh saves.
+const size_t MIN_INSTANCES_PER_PROTOTYPE = 8;
+
+// Per-instance attributes, read once per instance instead of once per vertex
+struct InstanceAttributes {
+    glm::vec3 offset; // where the first corner of the prototype goes
+    glm::vec3 color;  // multiplies the prototype colors
+};
+
+struct PrototypeVertex {
+    glm::vec3 position; // relative to the first corner
+    glm::vec3 color;
+};
+
+// One instanced draw call: the prototype indices [first, first + count) drawn for the instances
+// [first_instance, first_instance + instance_count). base_vertex is the first prototype vertex.
+struct InstanceBatch {
+    PrimitiveType primitive;
+    size_t first;
+    size_t count;
+    int32_t base_vertex;
+    size_t first_instance;
+    size_t instance_count;
+};
+
+// Triangles and lines drawn as copies of shared prototypes moved into place. Primitives with one
+// color all over get a white prototype and their color per instance, so recoloring or moving one
+// only rewrites its instance. Instances of one prototype are next to each other and triangle
+// batches come before line batches.
+struct InstancedMesh {
+    std::vector<PrototypeVertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<InstanceAttributes> instances;
+    std::vector<InstanceBatch> batches;
+    std::vector<uint32_t> triangle_instances; // instance drawing every triangle
+    std::vector<uint32_t> line_instances;
+    float epsilon;
+};
+
+// Shape and prototype colors of a primitive snapped like weld keys, unused corners left 0
+struct InstanceKey {
+    int64_t v[15];
+
+    bool operator==(const InstanceKey& other) const {
+        return memcmp(v, other.v, sizeof(v)) == 0;
+    }
+};
+
+struct InstanceKeyHash {
+    size_t operator()(const InstanceKey& key) const {
+        uint64_t h = 1469598103934665603ull;
+        for (int i = 0; i < 15; i++) {
+            h = (h ^ (uint64_t)key.v[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+// Splits a primitive into a prototype relative to its first corner and the color its instance
+// carries
+void describe_primitive(const glm::vec3* positions, const glm::vec3* colors, int corners,
+                        glm::vec3* shape, glm::vec3* shape_colors, glm::vec3& instance_color) {
+    bool one_color = true;
+    for (int k = 0; k < corners; k++) {
+        shape[k] = positions[k] - positions[0];
+        one_color = one_color && colors[k] == colors[0];
+    }
+    instance_color = one_color ? colors[0] : glm::vec3(1.0f);
+    for (int k = 0; k < corners; k++) {
+        shape_colors[k] = one_color ? glm::vec3(1.0f) : colors[k];
+    }
+}
+
+// Whether a described primitive can be drawn with the prototype starting at the given vertex
+bool fits_prototype(const InstancedMesh& mesh, int32_t base_vertex, const glm::vec3* shape,
+                    const glm::vec3* shape_colors, int corners) {
+    for (int k = 0; k < corners; k++) {
+        const PrototypeVertex& vertex = mesh.vertices[base_vertex + k];
+        glm::vec3 offset = glm::abs(vertex.position - shape[k]);
+        if (std::max(offset.x, std::max(offset.y, offset.z)) > mesh.epsilon ||
+            vertex.color != shape_colors[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Groups count primitives of the given kind by prototype. corner_data(i, positions, colors) fills
+// in the corners of primitive i.
+template <typename Corners>
+void add_instance_batches(InstancedMesh& mesh, PrimitiveType primitive, int corners,
+                          size_t count, Corners corner_data,
+                          std::vector<uint32_t>& primitive_instances) {
+    // Every prototype is a single primitive, so they all share one run of indices
+    size_t first_index = mesh.indices.size();
+    for (int k = 0; k < corners; k++) {
+        mesh.indices.push_back(k);
+    }
+
+    std::unordered_map<InstanceKey, uint32_t, InstanceKeyHash> prototypes;
+    std::vector<uint32_t> prototype_of(count);
+    std::vector<InstanceAttributes> attributes(count);
+    std::vector<size_t> instance_counts;
+    size_t first_batch = mesh.batches.size();
+    glm::vec3 positions[3], colors[3], shape[3], shape_colors[3];
+    for (size_t i = 0; i < count; i++) {
+        corner_data(i, positions, colors);
+        describe_primitive(positions, colors, corners, shape, shape_colors, attributes[i].color);
+        attributes[i].offset = positions[0];
+
+        InstanceKey key;
+        memset(key.v, 0, sizeof(key.v));
+        // The first corner is always at the origin, so only the others go into the key
+        for (int k = 0; k < corners; k++) {
+            for (int j = 0; j < 3; j++) {
+                if (k > 0) {
+                    key.v[3 * (k - 1) + j] = weld_coordinate(shape[k][j], mesh.epsilon);
+                }
+                key.v[6 + 3 * k + j] = weld_coordinate(shape_colors[k][j], mesh.epsilon);
+            }
+        }
+        auto inserted = prototypes.insert(std::make_pair(key, (uint32_t)instance_counts.size()));
+        if (inserted.second) {
+            InstanceBatch batch;
+            batch.primitive = primitive;
+            batch.first = first_index;
+            batch.count = corners;
+            batch.base_vertex = mesh.vertices.size();
+            mesh.batches.push_back(batch);
+            for (int k = 0; k < corners; k++) {
+                mesh.vertices.push_back(
+                    (PrototypeVertex){.position = shape[k], .color = shape_colors[k]});
+            }
+            instance_counts.push_back(0);
+        }
+        prototype_of[i] = inserted.first->second;
+        instance_counts[prototype_of[i]]++;
+    }
+
+    // Lay the instances out prototype by prototype, keeping primitive order within each
+    size_t next = mesh.instances.size();
+    for (size_t p = 0; p < instance_counts.size(); p++) {
+        InstanceBatch& batch = mesh.batches[first_batch + p];
+        batch.first_instance = next;
+        batch.instance_count = instance_counts[p];
+        next += instance_counts[p];
+        instance_counts[p] = 0;
+    }
+    mesh.instances.resize(next);
+    primitive_instances.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t p = prototype_of[i];
+        uint32_t instance = mesh.batches[first_batch + p].first_instance + instance_counts[p]++;
+        mesh.instances[instance] = attributes[i];
+        primitive_instances[i] = instance;
+    }
+}
+
+void create_instanced_mesh(const TriangleStore& triangles, const LineStore& lines,
+                           InstancedMesh& mesh, float epsilon = INSTANCE_EPSILON) {
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.instances.clear();
+    mesh.batches.clear();
+    mesh.epsilon = epsilon;
+    add_instance_batches(mesh, PrimitiveType::TRIANGLES, TRI_VERTEX_COUNT, triangles.size(),
+                         [&](size_t i, glm::vec3* positions, glm::vec3* colors) {
+                             positions[0] = triangles.a_pos[i];
+                             positions[1] = triangles.b_pos[i];
+                             positions[2] = triangles.c_pos[i];
+                             colors[0] = triangles.a_col[i];
+                             colors[1] = triangles.b_col[i];
+                             colors[2] = triangles.c_col[i];
+                         },
+                         mesh.triangle_instances);
+    add_instance_batches(mesh, PrimitiveType::LINES, LINE_VERTEX_COUNT, lines.size(),
+                         [&](size_t i, glm::vec3* positions, glm::vec3* colors) {
+                             positions[0] = lines.a_pos[i];
+                             positions[1] = lines.b_pos[i];
+                             colors[0] = lines.a_col[i];
+                             colors[1] = lines.b_col[i];
+                         },
+                         mesh.line_instances);
+}
+
+// The batch drawing an instance
+const InstanceBatch& instance_batch(const InstancedMesh& mesh, uint32_t instance) {
+    auto after = std::upper_bound(mesh.batches.begin(), mesh.batches.end(), instance,
+                                  [](uint32_t instance, const InstanceBatch& batch) {
+                                      return instance < batch.first_instance;
+                                  });
+    return *(after - 1);
+}
+
+// Rewrites one instance if the primitive still fits its prototype
+bool update_instance(InstancedMesh& mesh, uint32_t instance, const glm::vec3* positions,
+                     const glm::vec3* colors, int corners, DirtyRanges& dirty) {
+    glm::vec3 shape[3], shape_colors[3], instance_color;
+    describe_primitive(positions, colors, corners, shape, shape_colors, instance_color);
+    if (!fits_prototype(mesh, instance_batch(mesh, instance).base_vertex, shape, shape_colors,
+                        corners)) {
+        return false;
+    }
+    mesh.instances[instance] =
+        (InstanceAttributes){.offset = positions[0], .color = instance_color};
+    add_dirty_range(dirty, instance * sizeof(InstanceAttributes),
+                    (instance + 1) * sizeof(InstanceAttributes));
+    return true;
+}
+
+// Patches the instances of the given lines and triangles after they moved or changed color,
+// adding the touched bytes of the instance array to dirty. Returns false when the mesh has to be
+// rebuilt with create_instanced_mesh() instead: when primitives were added or removed, or when one
+// changed shape or picked up a mix of colors its prototype doesn't have.
+bool update_instances(const TriangleStore& triangles, const LineStore& lines,
+                      const std::vector<uint32_t>& dirty_triangles,
+                      const std::vector<uint32_t>& dirty_lines, InstancedMesh& mesh,
+                      DirtyRanges& dirty) {
+    if (mesh.triangle_instances.size() != triangles.size() ||
+        mesh.line_instances.size() != lines.size()) {
+        return false;
+    }
+    glm::vec3 positions[3], colors[3];
+    for (auto j : dirty_triangles) {
+        positions[0] = triangles.a_pos[j];
+        positions[1] = triangles.b_pos[j];
+        positions[2] = triangles.c_pos[j];
+        colors[0] = triangles.a_col[j];
+        colors[1] = triangles.b_col[j];
+        colors[2] = triangles.c_col[j];
+        if (!update_instance(mesh, mesh.triangle_instances[j], positions, colors,
+                             TRI_VERTEX_COUNT, dirty)) {
+            return false;
+        }
+    }
+    for (auto i : dirty_lines) {
+        positions[0] = lines.a_pos[i];
+        positions[1] = lines.b_pos[i];
+        colors[0] = lines.a_col[i];
+        colors[1] = lines.b_col[i];
+        if (!update_instance(mesh, mesh.line_instances[i], positions, colors, LINE_VERTEX_COUNT,
+                             dirty)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bytes the GPU holds for an instanced mesh: prototypes, their indices and the instances
+size_t instanced_mesh_bytes(const InstancedMesh& mesh) {
+    return mesh.vertices.size() * sizeof(PrototypeVertex) +
+           mesh.indices.size() * sizeof(uint16_t) +
+           mesh.instances.size() * sizeof(InstanceAttributes);
+}
+
+// One command per prototype, with base_instance at its first instance so the instance attributes
+// don't have to be pointed at it. Triangle prototypes come before line ones, so a multi-draw call
+// per run draws the whole mesh in two calls.
+void build_instanced_draw_commands(const InstancedMesh& mesh, DrawCommandList& list) {
+    clear_draw_commands(list);
+    for (const auto& batch : mesh.batches) {
+        add_draw_command(list, batch.primitive, IndexType::U16, batch.count,
+                         batch.first * sizeof(uint16_t), batch.base_vertex, batch.instance_count,
+                         batch.first_instance);
+    }
+}
+
+// Whether the instanced mesh is a better way to draw the scene than the packed mesh taking
+// packed_bytes. Scenes of mostly unique primitives end up with about one prototype per primitive,
+// which is more memory and more draw calls than drawing them packed.
+bool instancing_pays_off(const InstancedMesh& mesh, size_t packed_bytes) {
+    return mesh.batches.size() * MIN_INSTANCES_PER_PROTOTYPE <= mesh.instances.size() &&
+           instanced_mesh_bytes(mesh) < packed_bytes;
+}
+
+#endif
@@ -0,0 +1,519 @@
+#include "../include/glm/glm.hpp"
+#include "bvh.hpp"
+#include "constants.hpp"
+#include "geometry.hpp"
+#include "intersection_simd.hpp"
+#include "segment_distance.hpp"
+#include "spatial_hash.hpp"
+#include "thread_pool.hpp"
+#include "triangle_record.hpp"
+#include "triangle_triangle.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef intersection_hpp
+#define intersection_hpp
+
+enum class IntersectionMode {
+    BRUTE_FORCE, // Test every line against every triangle, kept as a reference
+    BVH,         // Only test the triangles in the BVH leaves each line passes through
+    GRID         // Only test the triangles binned in the grid cells each line passes through
+};
+
+enum class NarrowPhase {
+    SEGMENT, // Moller-Trumbore on precomputed triangle records, correct for any orientation
+    EXACT,   // Exact orientation predicates, no tolerance and coplanar segments never hit
+    LEGACY   // The original intersects(), which only sees triangles counter-clockwise from +Z
+};
+
+// Lines are handed out to threads in chunks of this size. It doesn't depend on the thread count
+// so the merged hit order is the same for any number of threads.
+const size_t LINES_PER_CHUNK = 256;
+const size_t BOXES_PER_CHUNK = 256;
+
+struct IntersectionConfig {
+    IntersectionMode mode;
+    NarrowPhase narrow_phase;
+    size_t thread_count;
+};
+
+IntersectionConfig default_intersection_config() {
+    return (IntersectionConfig){
+        .mode = IntersectionMode::BVH, .narrow_phase = NarrowPhase::SEGMENT, .thread_count = 1};
+}
+
+struct HitPair {
+    uint32_t line;
+    uint32_t triangle;
+};
+
+// Two triangles that overlap, with first < second
+struct TrianglePair {
+    uint32_t first;
+    uint32_t second;
+};
+
+// Two lines that pass within the clearance of each other, with first < second
+struct LinePair {
+    uint32_t first;
+    uint32_t second;
+    float distance; // closest approach
+};
+
+// Where a line hits a triangle. The point is line.a_pos + t * (line.b_pos - line.a_pos), which is
+// also a_pos + u * (b_pos - a_pos) + v * (c_pos - a_pos) on the triangle. t, u and v always come
+// from Moller-Trumbore on the triangle record, whichever narrow phase found the hit. With LEGACY
+// and EXACT they are worked out again after the fact, so for a hit those tests accept right on an
+// edge they can fall a rounding error outside [0, 1].
+struct HitRecord {
+    uint32_t line;
+    uint32_t triangle;
+    float t;
+    float u;
+    float v;
+    glm::vec3 point;
+};
+
+// What find_hits() builds on the way to the hits: the broad phase over the triangles, the
+// triangles packed for the narrow phase and per-thread buffers. Everything is rebuilt on every
+// query but keeps its storage, so a scratch passed to every query stops allocating once it has
+// grown to the scene.
+struct HitScratch {
+    std::vector<AABB> boxes;
+    BVH bvh;
+    SpatialHash grid;
+    PackedTriangles triangles;
+    PackedCorners corners;
+    PackedRecords records;
+    std::vector<std::vector<uint32_t> > candidates; // grid candidates per worker
+    std::vector<std::vector<uint32_t> > last_line;  // last line that tested each triangle
+    CollectScratch<HitPair> collect;
+};
+
+// Results of query_hits(), ordered by line. Keep one around and pass it to every query so the
+// storage is reused instead of allocated again each frame.
+struct HitBuffer {
+    std::vector<HitRecord> hits;
+    std::vector<HitPair> pairs; // scratch space for the broad and narrow phases
+    HitScratch scratch;
+};
+
+bool intersects(const Line& line, const Triangle& triangle) {
+    // We will find the point at which the ray intersects the plane defined by the triangle and then
+    // check if that point is within the triangle.
+
+    // To find the point at which the ray intersects the plane we will use the fact that the normal
+    // of the plane and a vector within the plane would be orthogonal (so their cross product would
+    // be 0). We will take the vector on the plane to be defined by one of the points of the
+    // triangle and the point at which the ray intersects the plane.
+    glm::vec3 n = glm::normalize(
+        glm::cross((triangle.b_pos - triangle.a_pos), (triangle.c_pos - triangle.b_pos)));
+
+    glm::vec3 p_tri = triangle.a_pos;
+
+    // We can define the ray with the equation a + d*t = p where p is a point in the ray
+    // a would be the start of the line, d the direction and p the point of intersection
+    glm::vec3 a = line.a_pos;
+    glm::vec3 b = line.b_pos;
+    glm::vec3 l = glm::normalize(line.b_pos - line.a_pos);
+
+    // If you put the ray equation inside the cross product mentioned above you can solve for t
+    float l_dot_n = glm::dot(l, n);
+    if (l_dot_n < TINY_NUMBER && l_dot_n > -TINY_NUMBER) {
+        return false;
+    }
+    float t = glm::dot(p_tri - a, n) / l_dot_n;
+
+    // Now we have the point in the plane
+    glm::vec3 p_ray = a + (t * l);
+
+    // If the point is not on the line then the reay doesn't intersect the plane
+    if (glm::length(b - a) - glm::length(p_ray - a) - glm::length(b - p_ray) < TINY_NUMBER ||
+        glm::length(b - a) - glm::length(p_ray - a) - glm::length(b - p_ray) > -TINY_NUMBER) {
+        return false;
+    }
+
+    // Check if the point on the plane is inside the triangle by checking if it's to the left of
+    // each side
+    if (is_left(glm::vec2(triangle.a_pos), glm::vec2(triangle.b_pos), glm::vec2(p_ray)) &&
+        is_left(glm::vec2(triangle.b_pos), glm::vec2(triangle.c_pos), glm::vec2(p_ray)) &&
+        is_left(glm::vec2(triangle.c_pos), glm::vec2(triangle.a_pos), glm::vec2(p_ray))) {
+        return true;
+    }
+
+    return false;
+}
+
+bool intersects(const Line& line, const Triangle& triangle, NarrowPhase narrow_phase) {
+    if (narrow_phase == NarrowPhase::LEGACY) {
+        return intersects(line, triangle);
+    }
+    if (narrow_phase == NarrowPhase::EXACT) {
+        return intersects_segment_exact(line.a_pos, line.b_pos, triangle.a_pos, triangle.b_pos,
+                                        triangle.c_pos);
+    }
+    return intersects_segment(line.a_pos, line.b_pos,
+                              make_triangle_record(triangle.a_pos, triangle.b_pos, triangle.c_pos));
+}
+
+void mark_hit(LineRef line, TriangleRef triangle) {
+    line.a_col = glm::vec3(RED_COLOR);
+    line.b_col = glm::vec3(RED_COLOR);
+    triangle.a_col = glm::vec3(ORANGE_COLOR);
+    triangle.b_col = glm::vec3(ORANGE_COLOR);
+    triangle.c_col = glm::vec3(ORANGE_COLOR);
+}
+
+AABB triangle_bounds(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    AABB box = empty_aabb();
+    grow(box, a);
+    grow(box, b);
+    grow(box, c);
+    pad(box);
+    return box;
+}
+
+void triangle_bounds(const TriangleStore& triangles, std::vector<AABB>& boxes) {
+    boxes.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        boxes[i] = triangle_bounds(triangles.a_pos[i], triangles.b_pos[i], triangles.c_pos[i]);
+    }
+}
+
+AABB line_bounds(const glm::vec3& a, const glm::vec3& b) {
+    AABB box = empty_aabb();
+    grow(box, a);
+    grow(box, b);
+    pad(box);
+    return box;
+}
+
+void line_bounds(const LineStore& lines, std::vector<AABB>& boxes) {
+    boxes.resize(lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        boxes[i] = line_bounds(lines.a_pos[i], lines.b_pos[i]);
+    }
+}
+
+void build_triangle_bvh(const TriangleStore& triangles, BVH& bvh, std::vector<AABB>& boxes) {
+    triangle_bounds(triangles, boxes);
+    bvh.build(boxes);
+}
+
+void build_triangle_grid(const TriangleStore& triangles, SpatialHash& grid,
+                         std::vector<AABB>& boxes) {
+    triangle_bounds(triangles, boxes);
+    grid.build(boxes);
+}
+
+// Runs the narrow phase for every line on whatever the broad phase hands it. Triangles are packed
+// in BVH order in BVH mode and in store order otherwise.
+template <typename Packed>
+void find_packed_hits(const Packed& packed, const LineStore& lines,
+                      const IntersectionConfig& config, std::vector<HitPair>& hits,
+                      HitScratch& scratch) {
+    ThreadPool& pool = shared_thread_pool(config.thread_count);
+    const BVH& bvh = scratch.bvh;
+    const SpatialHash& grid = scratch.grid;
+    // Stamps of the last line that tested each triangle, so a triangle that spans several cells
+    // is only tested once per line
+    std::vector<std::vector<uint32_t> >& candidates = scratch.candidates;
+    std::vector<std::vector<uint32_t> >& last_line = scratch.last_line;
+    candidates.resize(pool.size());
+    last_line.resize(pool.size());
+    if (config.mode == IntersectionMode::GRID) {
+        for (auto& stamps : last_line) {
+            stamps.assign(packed.count, UINT32_MAX);
+        }
+    }
+
+    parallel_collect(pool, lines.size(), LINES_PER_CHUNK, hits,
+                     [&](size_t line, size_t worker, std::vector<HitPair>& buffer) {
+        LineQuery query = make_line_query(lines.a_pos[line], lines.b_pos[line]);
+        if (config.mode == IntersectionMode::BRUTE_FORCE) {
+            for_each_packet_hit(query, packed, 0, packed.count, [&](size_t i) {
+                buffer.push_back((HitPair){.line = (uint32_t)line, .triangle = (uint32_t)i});
+            });
+            return;
+        }
+        if (config.mode == IntersectionMode::GRID) {
+            std::vector<uint32_t>& found = candidates[worker];
+            std::vector<uint32_t>& stamps = last_line[worker];
+            found.clear();
+            grid.query_segment(query.a, query.b, [&](uint32_t i) {
+                if (stamps[i] != line) {
+                    stamps[i] = line;
+                    found.push_back(i);
+                }
+            });
+            // Sorted so hits come out in the same order as with the brute force test
+            std::sort(found.begin(), found.end());
+            for (auto i : found) {
+                if (intersects_packed(query, packed, i)) {
+                    buffer.push_back((HitPair){.line = (uint32_t)line, .triangle = i});
+                }
+            }
+            return;
+        }
+        bvh.query_segment(query.a, query.b, [&](uint32_t first, uint32_t count) {
+            for_each_packet_hit(query, packed, first, count, [&](size_t i) {
+                buffer.push_back((HitPair){.line = (uint32_t)line, .triangle = bvh.indices[i]});
+            });
+        });
+    }, scratch.collect);
+}
+
+// Finds every (line, triangle) pair that intersects, ordered by line, building the broad phase in
+// scratch
+void find_hits(const TriangleStore& triangles, const LineStore& lines,
+               const IntersectionConfig& config, std::vector<HitPair>& hits,
+               HitScratch& scratch) {
+    const std::vector<uint32_t>* order = NULL;
+    if (config.mode == IntersectionMode::BVH) {
+        // Packed in the order leaves are visited so each leaf is a contiguous range
+        build_triangle_bvh(triangles, scratch.bvh, scratch.boxes);
+        order = &scratch.bvh.indices;
+    } else if (config.mode == IntersectionMode::GRID) {
+        build_triangle_grid(triangles, scratch.grid, scratch.boxes);
+    }
+
+    if (config.narrow_phase == NarrowPhase::LEGACY) {
+        pack_triangles(triangles, order, scratch.triangles);
+        find_packed_hits(scratch.triangles, lines, config, hits, scratch);
+    } else if (config.narrow_phase == NarrowPhase::EXACT) {
+        pack_triangle_corners(triangles, order, scratch.corners);
+        find_packed_hits(scratch.corners, lines, config, hits, scratch);
+    } else {
+        pack_triangle_records(triangles, order, scratch.records);
+        find_packed_hits(scratch.records, lines, config, hits, scratch);
+    }
+}
+
+void find_hits(const TriangleStore& triangles, const LineStore& lines,
+               const IntersectionConfig& config, std::vector<HitPair>& hits) {
+    HitScratch scratch;
+    find_hits(triangles, lines, config, hits, scratch);
+}
+
+// Finds every hit like find_hits() and records where it happened. Nothing is allocated once the
+// buffer has grown to the scene.
+void query_hits(const TriangleStore& triangles, const LineStore& lines,
+                const IntersectionConfig& config, HitBuffer& buffer) {
+    find_hits(triangles, lines, config, buffer.pairs, buffer.scratch);
+    buffer.hits.resize(buffer.pairs.size());
+    for (size_t n = 0; n < buffer.pairs.size(); n++) {
+        const HitPair& pair = buffer.pairs[n];
+        HitRecord& hit = buffer.hits[n];
+        hit.line = pair.line;
+        hit.triangle = pair.triangle;
+        glm::vec3 a = lines.a_pos[pair.line];
+        glm::vec3 b = lines.b_pos[pair.line];
+        TriangleRecord record = make_triangle_record(
+            triangles.a_pos[pair.triangle], triangles.b_pos[pair.triangle],
+            triangles.c_pos[pair.triangle]);
+        segment_hit_parameters(a, b, record, hit.t, hit.u, hit.v);
+        hit.point = a + hit.t * (b - a);
+    }
+}
+
+void mark_hits(const HitBuffer& buffer, TriangleStore& triangles, LineStore& lines) {
+    for (const auto& hit : buffer.hits) {
+        mark_hit(lines[hit.line], triangles[hit.triangle]);
+    }
+}
+
+void mark_intersections(TriangleStore& triangles, LineStore& lines,
+                        const IntersectionConfig& config = default_intersection_config()) {
+    HitBuffer buffer;
+    query_hits(triangles, lines, config, buffer);
+    mark_hits(buffer, triangles, lines);
+}
+
+// Calls test(i, j, buffer) for every pair i < j whose boxes come within margin of each other,
+// through the broad phase config.mode picks, and merges what the tests append to buffer ordered by
+// i and then j
+template <typename T, typename Test>
+void find_box_pairs(const std::vector<AABB>& boxes, float margin, const IntersectionConfig& config,
+                    std::vector<T>& pairs, Test test) {
+    BVH bvh;
+    SpatialHash grid;
+    if (config.mode == IntersectionMode::BVH) {
+        bvh.build(boxes);
+    } else if (config.mode == IntersectionMode::GRID) {
+        grid.build(boxes);
+    }
+
+    ThreadPool& pool = shared_thread_pool(config.thread_count);
+    // Candidates per worker, and the last box that collected each one so a box binned in several
+    // grid cells is only tested once
+    std::vector<std::vector<uint32_t> > candidates(pool.size());
+    std::vector<std::vector<uint32_t> > last_box(pool.size());
+    if (config.mode == IntersectionMode::GRID) {
+        for (auto& stamps : last_box) {
+            stamps.assign(boxes.size(), UINT32_MAX);
+        }
+    }
+
+    parallel_collect(pool, boxes.size(), BOXES_PER_CHUNK, pairs,
+                     [&](size_t i, size_t worker, std::vector<T>& buffer) {
+        AABB query = boxes[i];
+        query.min -= glm::vec3(margin);
+        query.max += glm::vec3(margin);
+        // Each pair is only looked at from its lower index
+        std::vector<uint32_t>& found = candidates[worker];
+        found.clear();
+        if (config.mode == IntersectionMode::BRUTE_FORCE) {
+            for (size_t j = i + 1; j < boxes.size(); j++) {
+                if (overlaps(query, boxes[j])) {
+                    found.push_back(j);
+                }
+            }
+        } else if (config.mode == IntersectionMode::GRID) {
+            std::vector<uint32_t>& stamps = last_box[worker];
+            grid.query_box(query, [&](uint32_t j) {
+                if (j > i && stamps[j] != i) {
+                    stamps[j] = i;
+                    found.push_back(j);
+                }
+            });
+        } else {
+            bvh.query_box(query, [&](uint32_t first, uint32_t count) {
+                for (uint32_t k = first; k < first + count; k++) {
+                    uint32_t j = bvh.indices[k];
+                    if (j > i && overlaps(query, boxes[j])) {
+                        found.push_back(j);
+                    }
+                }
+            });
+        }
+        // Sorted so pairs come out in the same order as with the brute force test
+        std::sort(found.begin(), found.end());
+        for (auto j : found) {
+            test((uint32_t)i, j, buffer);
+        }
+    });
+}
+
+// Neighbours in a mesh always touch where they share corners, so triangles_intersect() would
+// report every one of them. Sets shared to the number of corners v and u have in common, and when
+// that is not 0 returns whether they overlap anywhere past those corners.
+bool adjacent_triangles_intersect(const glm::vec3 v[3], const glm::vec3 u[3], int& shared) {
+    int v_corner = 0, u_corner = 0;
+    bool v_shared[3] = {false, false, false};
+    bool u_shared[3] = {false, false, false};
+    shared = 0;
+    for (int m = 0; m < 3; m++) {
+        for (int n = 0; n < 3; n++) {
+            if (v[m] == u[n] && !v_shared[m] && !u_shared[n]) {
+                v_shared[m] = true;
+                u_shared[n] = true;
+                v_corner = m;
+                u_corner = n;
+                shared++;
+            }
+        }
+    }
+    if (shared == 1) {
+        // Any overlap past the shared corner reaches the edge opposite it in one of the triangles
+        return segment_triangle_intersect(v[(v_corner + 1) % 3], v[(v_corner + 2) % 3], u) ||
+               segment_triangle_intersect(u[(u_corner + 1) % 3], u[(u_corner + 2) % 3], v);
+    }
+    if (shared == 2) {
+        // Sharing an edge, they only overlap past it when they lie in one plane and fold onto the
+        // same side of it
+        int v_free = !v_shared[0] ? 0 : !v_shared[1] ? 1 : 2;
+        int u_free = !u_shared[0] ? 0 : !u_shared[1] ? 1 : 2;
+        glm::vec3 a = v[(v_free + 1) % 3];
+        glm::vec3 edge = v[(v_free + 2) % 3] - a;
+        glm::vec3 n = glm::cross(edge, v[v_free] - a);
+        if (glm::dot(n, u[u_free] - a) != 0.0f) {
+            return false;
+        }
+        return glm::dot(n, glm::cross(edge, u[u_free] - a)) > 0.0f;
+    }
+    // The same triangle twice
+    return shared == 3;
+}
+
+bool triangles_intersect(const TriangleStore& triangles, size_t i, size_t j, bool skip_adjacent) {
+    const glm::vec3 v[3] = {triangles.a_pos[i], triangles.b_pos[i], triangles.c_pos[i]};
+    const glm::vec3 u[3] = {triangles.a_pos[j], triangles.b_pos[j], triangles.c_pos[j]};
+    if (skip_adjacent) {
+        int shared;
+        bool overlap = adjacent_triangles_intersect(v, u, shared);
+        if (shared > 0) {
+            return overlap;
+        }
+    }
+    return triangles_intersect(v, u);
+}
+
+// Finds every pair of triangles that overlap, ordered by first and then second. The broad phase
+// follows config.mode and the narrow phase is triangles_intersect(). Neighbours in a mesh touch
+// where they share corners, so with skip_adjacent such pairs only count when they overlap
+// somewhere else as well.
+void find_triangle_overlaps(const TriangleStore& triangles, const IntersectionConfig& config,
+                            std::vector<TrianglePair>& pairs, bool skip_adjacent = true) {
+    std::vector<AABB> boxes;
+    triangle_bounds(triangles, boxes);
+    find_box_pairs(boxes, 0.0f, config, pairs,
+                   [&](uint32_t i, uint32_t j, std::vector<TrianglePair>& buffer) {
+        if (triangles_intersect(triangles, i, j, skip_adjacent)) {
+            buffer.push_back((TrianglePair){.first = i, .second = j});
+        }
+    });
+}
+
+void mark_overlap(TriangleRef triangle) {
+    triangle.a_col = glm::vec3(ORANGE_COLOR);
+    triangle.b_col = glm::vec3(ORANGE_COLOR);
+    triangle.c_col = glm::vec3(ORANGE_COLOR);
+}
+
+void mark_triangle_overlaps(const std::vector<TrianglePair>& pairs, TriangleStore& triangles) {
+    for (const auto& pair : pairs) {
+        mark_overlap(triangles[pair.first]);
+        mark_overlap(triangles[pair.second]);
+    }
+}
+
+bool shares_endpoint(const LineStore& lines, size_t i, size_t j) {
+    return lines.a_pos[i] == lines.a_pos[j] || lines.a_pos[i] == lines.b_pos[j] ||
+           lines.b_pos[i] == lines.a_pos[j] || lines.b_pos[i] == lines.b_pos[j];
+}
+
+// Finds every pair of lines that pass within clearance of each other, ordered by first and then
+// second. Boxes are grown by the clearance for the broad phase so only nearby lines are measured.
+// Wires joined end to end are always at distance 0, so with skip_connected lines that have an end
+// in the same place are left out.
+void find_close_lines(const LineStore& lines, float clearance, const IntersectionConfig& config,
+                      std::vector<LinePair>& pairs, bool skip_connected = true) {
+    std::vector<AABB> boxes;
+    line_bounds(lines, boxes);
+    float limit = clearance * clearance;
+    find_box_pairs(boxes, clearance, config, pairs,
+                   [&](uint32_t i, uint32_t j, std::vector<LinePair>& buffer) {
+        if (skip_connected && shares_endpoint(lines, i, j)) {
+            return;
+        }
+        float squared = segment_distance_squared(lines.a_pos[i], lines.b_pos[i], lines.a_pos[j],
+                                                 lines.b_pos[j]);
+        if (squared <= limit) {
+            buffer.push_back((LinePair){.first = i, .second = j, .distance = sqrtf(squared)});
+        }
+    });
+}
+
+void mark_close_lines(const std::vector<LinePair>& pairs, LineStore& lines) {
+    for (const auto& pair : pairs) {
+        lines.a_col[pair.first] = glm::vec3(BROWN_COLOR);
+        lines.b_col[pair.first] = glm::vec3(BROWN_COLOR);
+        lines.a_col[pair.second] = glm::vec3(BROWN_COLOR);
+        lines.b_col[pair.second] = glm::vec3(BROWN_COLOR);
+    }
+}
+
+#endif
@@ -0,0 +1,547 @@
+#include "../include/glm/glm.hpp"
+#include "constants.hpp"
+#include "geometry.hpp"
+#include "predicates.hpp"
+#include "simd.hpp"
+#include "triangle_record.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef intersection_simd_hpp
+#define intersection_simd_hpp
+
+// Structure-of-arrays copy of the triangle positions (and their normals, which only depend on the
+// triangle) so a packet of triangles can be loaded lane by lane. Arrays are padded past count so a
+// full packet can always be loaded from any index below count.
+struct PackedTriangles {
+    FloatArray ax, ay, az;
+    FloatArray bx, by, bz;
+    FloatArray cx, cy, cz;
+    FloatArray nx, ny, nz;
+    size_t count;
+};
+
+// Everything about a line the kernels need that doesn't depend on the triangle
+struct LineQuery {
+    glm::vec3 a;
+    glm::vec3 b;
+    glm::vec3 l;
+    float length;
+};
+
+LineQuery make_line_query(const glm::vec3& a, const glm::vec3& b) {
+    LineQuery query;
+    query.a = a;
+    query.b = b;
+    query.l = glm::normalize(b - a);
+    query.length = glm::length(b - a);
+    return query;
+}
+
+glm::vec3 triangle_normal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    return glm::normalize(glm::cross((b - a), (c - b)));
+}
+
+// Packs triangle order[i] into slot i, or triangle i when no order is given
+void pack_triangles(const TriangleStore& triangles, const std::vector<uint32_t>* order,
+                    PackedTriangles& packed) {
+    size_t count = order ? order->size() : triangles.size();
+    FloatArray* arrays[] = {&packed.ax, &packed.ay, &packed.az, &packed.bx, &packed.by, &packed.bz,
+                            &packed.cx, &packed.cy, &packed.cz, &packed.nx, &packed.ny, &packed.nz};
+    for (auto array : arrays) {
+        array->assign(count + SIMD_MAX_WIDTH, 0.0f);
+    }
+    packed.count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t j = order ? (*order)[i] : i;
+        const glm::vec3& a = triangles.a_pos[j];
+        const glm::vec3& b = triangles.b_pos[j];
+        const glm::vec3& c = triangles.c_pos[j];
+        glm::vec3 n = triangle_normal(a, b, c);
+        packed.ax[i] = a.x;
+        packed.ay[i] = a.y;
+        packed.az[i] = a.z;
+        packed.bx[i] = b.x;
+        packed.by[i] = b.y;
+        packed.bz[i] = b.z;
+        packed.cx[i] = c.x;
+        packed.cy[i] = c.y;
+        packed.cz[i] = c.z;
+        packed.nx[i] = n.x;
+        packed.ny[i] = n.y;
+        packed.nz[i] = n.z;
+    }
+}
+
+// The kernels below evaluate exactly the same float operations in the same order as intersects(),
+// so every instruction set gives bit-identical answers to the scalar reference.
+
+bool intersects_packed(const LineQuery& q, const PackedTriangles& p, size_t i) {
+    float l_dot_n = q.l.x * p.nx[i] + q.l.y * p.ny[i] + q.l.z * p.nz[i];
+    if (l_dot_n < TINY_NUMBER && l_dot_n > -TINY_NUMBER) {
+        return false;
+    }
+    float t = ((p.ax[i] - q.a.x) * p.nx[i] + (p.ay[i] - q.a.y) * p.ny[i] +
+               (p.az[i] - q.a.z) * p.nz[i]) /
+              l_dot_n;
+
+    glm::vec3 p_ray = q.a + (t * q.l);
+
+    float diff = q.length - glm::length(p_ray - q.a) - glm::length(q.b - p_ray);
+    if (diff < TINY_NUMBER || diff > -TINY_NUMBER) {
+        return false;
+    }
+
+    return is_left(glm::vec2(p.ax[i], p.ay[i]), glm::vec2(p.bx[i], p.by[i]), glm::vec2(p_ray)) &&
+           is_left(glm::vec2(p.bx[i], p.by[i]), glm::vec2(p.cx[i], p.cy[i]), glm::vec2(p_ray)) &&
+           is_left(glm::vec2(p.cx[i], p.cy[i]), glm::vec2(p.ax[i], p.ay[i]), glm::vec2(p_ray));
+}
+
+uint32_t intersects_packet_scalar(const LineQuery& q, const PackedTriangles& p, size_t first) {
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < SIMD_MAX_WIDTH; lane++) {
+        if (intersects_packed(q, p, first + lane)) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#ifdef SIMD_X86
+
+uint32_t intersects_packet_sse(const LineQuery& q, const PackedTriangles& p, size_t first) {
+    const __m128 tiny = _mm_set1_ps(TINY_NUMBER);
+    const __m128 neg_tiny = _mm_set1_ps(-TINY_NUMBER);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 qax = _mm_set1_ps(q.a.x), qay = _mm_set1_ps(q.a.y), qaz = _mm_set1_ps(q.a.z);
+    const __m128 qbx = _mm_set1_ps(q.b.x), qby = _mm_set1_ps(q.b.y), qbz = _mm_set1_ps(q.b.z);
+    const __m128 lx = _mm_set1_ps(q.l.x), ly = _mm_set1_ps(q.l.y), lz = _mm_set1_ps(q.l.z);
+    const __m128 length = _mm_set1_ps(q.length);
+
+    uint32_t mask = 0;
+    for (size_t offset = 0; offset < SIMD_MAX_WIDTH; offset += 4) {
+        size_t i = first + offset;
+        __m128 nx = _mm_loadu_ps(&p.nx[i]), ny = _mm_loadu_ps(&p.ny[i]),
+               nz = _mm_loadu_ps(&p.nz[i]);
+        __m128 ax = _mm_loadu_ps(&p.ax[i]), ay = _mm_loadu_ps(&p.ay[i]),
+               az = _mm_loadu_ps(&p.az[i]);
+
+        __m128 l_dot_n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, nx), _mm_mul_ps(ly, ny)),
+                                    _mm_mul_ps(lz, nz));
+        __m128 parallel =
+            _mm_and_ps(_mm_cmplt_ps(l_dot_n, tiny), _mm_cmpgt_ps(l_dot_n, neg_tiny));
+
+        __m128 w_dot_n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(ax, qax), nx),
+                                               _mm_mul_ps(_mm_sub_ps(ay, qay), ny)),
+                                    _mm_mul_ps(_mm_sub_ps(az, qaz), nz));
+        __m128 t = _mm_div_ps(w_dot_n, l_dot_n);
+
+        __m128 px = _mm_add_ps(qax, _mm_mul_ps(t, lx));
+        __m128 py = _mm_add_ps(qay, _mm_mul_ps(t, ly));
+        __m128 pz = _mm_add_ps(qaz, _mm_mul_ps(t, lz));
+
+        __m128 pax = _mm_sub_ps(px, qax), pay = _mm_sub_ps(py, qay), paz = _mm_sub_ps(pz, qaz);
+        __m128 bpx = _mm_sub_ps(qbx, px), bpy = _mm_sub_ps(qby, py), bpz = _mm_sub_ps(qbz, pz);
+        __m128 length_pa = _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(pax, pax), _mm_mul_ps(pay, pay)), _mm_mul_ps(paz, paz)));
+        __m128 length_bp = _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(bpx, bpx), _mm_mul_ps(bpy, bpy)), _mm_mul_ps(bpz, bpz)));
+        __m128 diff = _mm_sub_ps(_mm_sub_ps(length, length_pa), length_bp);
+        __m128 off_line = _mm_or_ps(_mm_cmplt_ps(diff, tiny), _mm_cmpgt_ps(diff, neg_tiny));
+
+        __m128 bx = _mm_loadu_ps(&p.bx[i]), by = _mm_loadu_ps(&p.by[i]);
+        __m128 cx = _mm_loadu_ps(&p.cx[i]), cy = _mm_loadu_ps(&p.cy[i]);
+        __m128 left_ab = _mm_cmpgt_ps(
+            _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(bx, ax), _mm_sub_ps(py, ay)),
+                       _mm_mul_ps(_mm_sub_ps(by, ay), _mm_sub_ps(px, ax))),
+            zero);
+        __m128 left_bc = _mm_cmpgt_ps(
+            _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(cx, bx), _mm_sub_ps(py, by)),
+                       _mm_mul_ps(_mm_sub_ps(cy, by), _mm_sub_ps(px, bx))),
+            zero);
+        __m128 left_ca = _mm_cmpgt_ps(
+            _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(ax, cx), _mm_sub_ps(py, cy)),
+                       _mm_mul_ps(_mm_sub_ps(ay, cy), _mm_sub_ps(px, cx))),
+            zero);
+
+        __m128 hit = _mm_andnot_ps(_mm_or_ps(parallel, off_line),
+                                   _mm_and_ps(left_ab, _mm_and_ps(left_bc, left_ca)));
+        mask |= (uint32_t)_mm_movemask_ps(hit) << offset;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) uint32_t intersects_packet_avx2(const LineQuery& q,
+                                                                const PackedTriangles& p,
+                                                                size_t first) {
+    const __m256 tiny = _mm256_set1_ps(TINY_NUMBER);
+    const __m256 neg_tiny = _mm256_set1_ps(-TINY_NUMBER);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 qax = _mm256_set1_ps(q.a.x), qay = _mm256_set1_ps(q.a.y),
+                 qaz = _mm256_set1_ps(q.a.z);
+    const __m256 qbx = _mm256_set1_ps(q.b.x), qby = _mm256_set1_ps(q.b.y),
+                 qbz = _mm256_set1_ps(q.b.z);
+    const __m256 lx = _mm256_set1_ps(q.l.x), ly = _mm256_set1_ps(q.l.y),
+                 lz = _mm256_set1_ps(q.l.z);
+    const __m256 length = _mm256_set1_ps(q.length);
+
+    size_t i = first;
+    __m256 nx = _mm256_loadu_ps(&p.nx[i]), ny = _mm256_loadu_ps(&p.ny[i]),
+           nz = _mm256_loadu_ps(&p.nz[i]);
+    __m256 ax = _mm256_loadu_ps(&p.ax[i]), ay = _mm256_loadu_ps(&p.ay[i]),
+           az = _mm256_loadu_ps(&p.az[i]);
+
+    __m256 l_dot_n = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, nx), _mm256_mul_ps(ly, ny)),
+                                   _mm256_mul_ps(lz, nz));
+    __m256 parallel = _mm256_and_ps(_mm256_cmp_ps(l_dot_n, tiny, _CMP_LT_OQ),
+                                    _mm256_cmp_ps(l_dot_n, neg_tiny, _CMP_GT_OQ));
+
+    __m256 w_dot_n =
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(ax, qax), nx),
+                                    _mm256_mul_ps(_mm256_sub_ps(ay, qay), ny)),
+                      _mm256_mul_ps(_mm256_sub_ps(az, qaz), nz));
+    __m256 t = _mm256_div_ps(w_dot_n, l_dot_n);
+
+    __m256 px = _mm256_add_ps(qax, _mm256_mul_ps(t, lx));
+    __m256 py = _mm256_add_ps(qay, _mm256_mul_ps(t, ly));
+    __m256 pz = _mm256_add_ps(qaz, _mm256_mul_ps(t, lz));
+
+    __m256 pax = _mm256_sub_ps(px, qax), pay = _mm256_sub_ps(py, qay),
+           paz = _mm256_sub_ps(pz, qaz);
+    __m256 bpx = _mm256_sub_ps(qbx, px), bpy = _mm256_sub_ps(qby, py),
+           bpz = _mm256_sub_ps(qbz, pz);
+    __m256 length_pa = _mm256_sqrt_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(pax, pax), _mm256_mul_ps(pay, pay)), _mm256_mul_ps(paz, paz)));
+    __m256 length_bp = _mm256_sqrt_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(bpx, bpx), _mm256_mul_ps(bpy, bpy)), _mm256_mul_ps(bpz, bpz)));
+    __m256 diff = _mm256_sub_ps(_mm256_sub_ps(length, length_pa), length_bp);
+    __m256 off_line = _mm256_or_ps(_mm256_cmp_ps(diff, tiny, _CMP_LT_OQ),
+                                   _mm256_cmp_ps(diff, neg_tiny, _CMP_GT_OQ));
+
+    __m256 bx = _mm256_loadu_ps(&p.bx[i]), by = _mm256_loadu_ps(&p.by[i]);
+    __m256 cx = _mm256_loadu_ps(&p.cx[i]), cy = _mm256_loadu_ps(&p.cy[i]);
+    __m256 left_ab = _mm256_cmp_ps(
+        _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(bx, ax), _mm256_sub_ps(py, ay)),
+                      _mm256_mul_ps(_mm256_sub_ps(by, ay), _mm256_sub_ps(px, ax))),
+        zero, _CMP_GT_OQ);
+    __m256 left_bc = _mm256_cmp_ps(
+        _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(cx, bx), _mm256_sub_ps(py, by)),
+                      _mm256_mul_ps(_mm256_sub_ps(cy, by), _mm256_sub_ps(px, bx))),
+        zero, _CMP_GT_OQ);
+    __m256 left_ca = _mm256_cmp_ps(
+        _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(ax, cx), _mm256_sub_ps(py, cy)),
+                      _mm256_mul_ps(_mm256_sub_ps(ay, cy), _mm256_sub_ps(px, cx))),
+        zero, _CMP_GT_OQ);
+
+    __m256 hit = _mm256_andnot_ps(_mm256_or_ps(parallel, off_line),
+                                  _mm256_and_ps(left_ab, _mm256_and_ps(left_bc, left_ca)));
+    return (uint32_t)_mm256_movemask_ps(hit);
+}
+
+#endif
+
+// Tests a line against the SIMD_MAX_WIDTH packed triangles starting at first and returns a bitmask
+// of the ones it hits. Lanes past the end of the packed data have to be masked out by the caller.
+uint32_t intersects_packet(const LineQuery& query, const PackedTriangles& packed, size_t first) {
+#ifdef SIMD_X86
+    if (simd_level == SimdLevel::AVX2) {
+        return intersects_packet_avx2(query, packed, first);
+    }
+    if (simd_level == SimdLevel::SSE) {
+        return intersects_packet_sse(query, packed, first);
+    }
+#endif
+    return intersects_packet_scalar(query, packed, first);
+}
+
+// Structure-of-arrays copy of TriangleRecord for the segment test kernels, padded like
+// PackedTriangles
+struct PackedRecords {
+    FloatArray ax, ay, az;
+    FloatArray e1x, e1y, e1z;
+    FloatArray e2x, e2y, e2z;
+    FloatArray nx, ny, nz;
+    FloatArray d;
+    size_t count;
+};
+
+// Packs the record of triangle order[i] into slot i, or of triangle i when no order is given
+void pack_triangle_records(const TriangleStore& triangles, const std::vector<uint32_t>* order,
+                           PackedRecords& packed) {
+    size_t count = order ? order->size() : triangles.size();
+    FloatArray* arrays[] = {&packed.ax,  &packed.ay,  &packed.az,  &packed.e1x, &packed.e1y,
+                            &packed.e1z, &packed.e2x, &packed.e2y, &packed.e2z, &packed.nx,
+                            &packed.ny,  &packed.nz,  &packed.d};
+    for (auto array : arrays) {
+        array->assign(count + SIMD_MAX_WIDTH, 0.0f);
+    }
+    packed.count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t j = order ? (*order)[i] : i;
+        TriangleRecord record =
+            make_triangle_record(triangles.a_pos[j], triangles.b_pos[j], triangles.c_pos[j]);
+        packed.ax[i] = record.a.x;
+        packed.ay[i] = record.a.y;
+        packed.az[i] = record.a.z;
+        packed.e1x[i] = record.e1.x;
+        packed.e1y[i] = record.e1.y;
+        packed.e1z[i] = record.e1.z;
+        packed.e2x[i] = record.e2.x;
+        packed.e2y[i] = record.e2.y;
+        packed.e2z[i] = record.e2.z;
+        packed.nx[i] = record.n.x;
+        packed.ny[i] = record.n.y;
+        packed.nz[i] = record.n.z;
+        packed.d[i] = record.d;
+    }
+}
+
+TriangleRecord unpack_triangle_record(const PackedRecords& p, size_t i) {
+    TriangleRecord record;
+    record.a = glm::vec3(p.ax[i], p.ay[i], p.az[i]);
+    record.e1 = glm::vec3(p.e1x[i], p.e1y[i], p.e1z[i]);
+    record.e2 = glm::vec3(p.e2x[i], p.e2y[i], p.e2z[i]);
+    record.n = glm::vec3(p.nx[i], p.ny[i], p.nz[i]);
+    record.d = p.d[i];
+    return record;
+}
+
+// The segment kernels below follow intersects_segment() operation for operation (glm's dot and
+// cross included), so they agree with it bit for bit like the legacy kernels do with intersects()
+
+bool intersects_packed(const LineQuery& q, const PackedRecords& p, size_t i) {
+    return intersects_segment(q.a, q.b, unpack_triangle_record(p, i));
+}
+
+uint32_t intersects_packet_scalar(const LineQuery& q, const PackedRecords& p, size_t first) {
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < SIMD_MAX_WIDTH; lane++) {
+        if (intersects_packed(q, p, first + lane)) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#ifdef SIMD_X86
+
+uint32_t intersects_packet_sse(const LineQuery& q, const PackedRecords& p, size_t first) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 qax = _mm_set1_ps(q.a.x), qay = _mm_set1_ps(q.a.y), qaz = _mm_set1_ps(q.a.z);
+    const __m128 qbx = _mm_set1_ps(q.b.x), qby = _mm_set1_ps(q.b.y), qbz = _mm_set1_ps(q.b.z);
+    glm::vec3 dir = q.b - q.a;
+    const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+
+    uint32_t mask = 0;
+    for (size_t offset = 0; offset < SIMD_MAX_WIDTH; offset += 4) {
+        size_t i = first + offset;
+        __m128 nx = _mm_loadu_ps(&p.nx[i]), ny = _mm_loadu_ps(&p.ny[i]),
+               nz = _mm_loadu_ps(&p.nz[i]), d = _mm_loadu_ps(&p.d[i]);
+
+        // Both ends strictly on one side of the plane
+        __m128 da = _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, qax), _mm_mul_ps(ny, qay)), _mm_mul_ps(nz, qaz)),
+            d);
+        __m128 db = _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, qbx), _mm_mul_ps(ny, qby)), _mm_mul_ps(nz, qbz)),
+            d);
+        __m128 miss = _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(da, zero), _mm_cmpgt_ps(db, zero)),
+                                _mm_and_ps(_mm_cmplt_ps(da, zero), _mm_cmplt_ps(db, zero)));
+        if (_mm_movemask_ps(miss) == 0xF) {
+            // Usually the whole packet misses here so the rest can be skipped
+            continue;
+        }
+
+        __m128 e1x = _mm_loadu_ps(&p.e1x[i]), e1y = _mm_loadu_ps(&p.e1y[i]),
+               e1z = _mm_loadu_ps(&p.e1z[i]);
+        __m128 e2x = _mm_loadu_ps(&p.e2x[i]), e2y = _mm_loadu_ps(&p.e2y[i]),
+               e2z = _mm_loadu_ps(&p.e2z[i]);
+
+        // pvec = cross(dir, e2), det = dot(e1, pvec)
+        __m128 pvx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+        __m128 pvy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+        __m128 pvz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, pvx), _mm_mul_ps(e1y, pvy)),
+                                _mm_mul_ps(e1z, pvz));
+        miss = _mm_or_ps(miss, _mm_cmpeq_ps(det, zero));
+        __m128 inv_det = _mm_div_ps(one, det);
+
+        // u from tvec = a - corner
+        __m128 tx = _mm_sub_ps(qax, _mm_loadu_ps(&p.ax[i]));
+        __m128 ty = _mm_sub_ps(qay, _mm_loadu_ps(&p.ay[i]));
+        __m128 tz = _mm_sub_ps(qaz, _mm_loadu_ps(&p.az[i]));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, pvx), _mm_mul_ps(ty, pvy)),
+                                         _mm_mul_ps(tz, pvz)),
+                              inv_det);
+        miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+
+        // qvec = cross(tvec, e1), then v and t
+        __m128 qvx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(e1y, tz));
+        __m128 qvy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(e1z, tx));
+        __m128 qvz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(e1x, ty));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qvx), _mm_mul_ps(dy, qvy)),
+                                         _mm_mul_ps(dz, qvz)),
+                              inv_det);
+        miss = _mm_or_ps(miss,
+                         _mm_or_ps(_mm_cmplt_ps(v, zero), _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qvx), _mm_mul_ps(e2y, qvy)),
+                                         _mm_mul_ps(e2z, qvz)),
+                              inv_det);
+        __m128 hit = _mm_andnot_ps(miss, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, one)));
+        mask |= (uint32_t)_mm_movemask_ps(hit) << offset;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) uint32_t intersects_packet_avx2(const LineQuery& q,
+                                                                const PackedRecords& p,
+                                                                size_t first) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 qax = _mm256_set1_ps(q.a.x), qay = _mm256_set1_ps(q.a.y),
+                 qaz = _mm256_set1_ps(q.a.z);
+    const __m256 qbx = _mm256_set1_ps(q.b.x), qby = _mm256_set1_ps(q.b.y),
+                 qbz = _mm256_set1_ps(q.b.z);
+    glm::vec3 dir = q.b - q.a;
+    const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y),
+                 dz = _mm256_set1_ps(dir.z);
+
+    size_t i = first;
+    __m256 nx = _mm256_loadu_ps(&p.nx[i]), ny = _mm256_loadu_ps(&p.ny[i]),
+           nz = _mm256_loadu_ps(&p.nz[i]), d = _mm256_loadu_ps(&p.d[i]);
+
+    // Both ends strictly on one side of the plane
+    __m256 da = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, qax),
+                                                          _mm256_mul_ps(ny, qay)),
+                                            _mm256_mul_ps(nz, qaz)),
+                              d);
+    __m256 db = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, qbx),
+                                                          _mm256_mul_ps(ny, qby)),
+                                            _mm256_mul_ps(nz, qbz)),
+                              d);
+    __m256 miss = _mm256_or_ps(
+        _mm256_and_ps(_mm256_cmp_ps(da, zero, _CMP_GT_OQ), _mm256_cmp_ps(db, zero, _CMP_GT_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(da, zero, _CMP_LT_OQ), _mm256_cmp_ps(db, zero, _CMP_LT_OQ)));
+    if (_mm256_movemask_ps(miss) == 0xFF) {
+        // Usually the whole packet misses here so the rest can be skipped
+        return 0;
+    }
+
+    __m256 e1x = _mm256_loadu_ps(&p.e1x[i]), e1y = _mm256_loadu_ps(&p.e1y[i]),
+           e1z = _mm256_loadu_ps(&p.e1z[i]);
+    __m256 e2x = _mm256_loadu_ps(&p.e2x[i]), e2y = _mm256_loadu_ps(&p.e2y[i]),
+           e2z = _mm256_loadu_ps(&p.e2z[i]);
+
+    // pvec = cross(dir, e2), det = dot(e1, pvec)
+    __m256 pvx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+    __m256 pvy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+    __m256 pvz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, pvx), _mm256_mul_ps(e1y, pvy)),
+                               _mm256_mul_ps(e1z, pvz));
+    miss = _mm256_or_ps(miss, _mm256_cmp_ps(det, zero, _CMP_EQ_OQ));
+    __m256 inv_det = _mm256_div_ps(one, det);
+
+    // u from tvec = a - corner
+    __m256 tx = _mm256_sub_ps(qax, _mm256_loadu_ps(&p.ax[i]));
+    __m256 ty = _mm256_sub_ps(qay, _mm256_loadu_ps(&p.ay[i]));
+    __m256 tz = _mm256_sub_ps(qaz, _mm256_loadu_ps(&p.az[i]));
+    __m256 u = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, pvx), _mm256_mul_ps(ty, pvy)),
+                      _mm256_mul_ps(tz, pvz)),
+        inv_det);
+    miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ),
+                                           _mm256_cmp_ps(u, one, _CMP_GT_OQ)));
+
+    // qvec = cross(tvec, e1), then v and t
+    __m256 qvx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(e1y, tz));
+    __m256 qvy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(e1z, tx));
+    __m256 qvz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(e1x, ty));
+    __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qvx), _mm256_mul_ps(dy, qvy)),
+                      _mm256_mul_ps(dz, qvz)),
+        inv_det);
+    miss = _mm256_or_ps(miss,
+                        _mm256_or_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ),
+                                     _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ)));
+    __m256 t = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qvx), _mm256_mul_ps(e2y, qvy)),
+                      _mm256_mul_ps(e2z, qvz)),
+        inv_det);
+    __m256 hit = _mm256_andnot_ps(miss, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ),
+                                                      _mm256_cmp_ps(t, one, _CMP_LE_OQ)));
+    return (uint32_t)_mm256_movemask_ps(hit);
+}
+
+#endif
+
+uint32_t intersects_packet(const LineQuery& query, const PackedRecords& packed, size_t first) {
+#ifdef SIMD_X86
+    if (simd_level == SimdLevel::AVX2) {
+        return intersects_packet_avx2(query, packed, first);
+    }
+    if (simd_level == SimdLevel::SSE) {
+        return intersects_packet_sse(query, packed, first);
+    }
+#endif
+    return intersects_packet_scalar(query, packed, first);
+}
+
+// Triangle corners for the exact predicates. They have no vector kernel so they are tested one
+// lane at a time, and most tests are settled by the floating-point filter anyway.
+struct PackedCorners {
+    std::vector<glm::vec3> a, b, c;
+    size_t count;
+};
+
+void pack_triangle_corners(const TriangleStore& triangles, const std::vector<uint32_t>* order,
+                           PackedCorners& packed) {
+    size_t count = order ? order->size() : triangles.size();
+    packed.a.assign(count + SIMD_MAX_WIDTH, glm::vec3(0.0f));
+    packed.b.assign(count + SIMD_MAX_WIDTH, glm::vec3(0.0f));
+    packed.c.assign(count + SIMD_MAX_WIDTH, glm::vec3(0.0f));
+    packed.count = count;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = order ? (*order)[i] : i;
+        packed.a[i] = triangles.a_pos[j];
+        packed.b[i] = triangles.b_pos[j];
+        packed.c[i] = triangles.c_pos[j];
+    }
+}
+
+bool intersects_packed(const LineQuery& q, const PackedCorners& p, size_t i) {
+    return intersects_segment_exact(q.a, q.b, p.a[i], p.b[i], p.c[i]);
+}
+
+uint32_t intersects_packet(const LineQuery& query, const PackedCorners& packed, size_t first) {
+    uint32_t mask = 0;
+    for (size_t lane = 0; lane < SIMD_MAX_WIDTH; lane++) {
+        if (intersects_packed(query, packed, first + lane)) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+// Calls visit(i) for every packed triangle in [first, first + count) the line hits
+template <typename Packed, typename Visitor>
+void for_each_packet_hit(const LineQuery& query, const Packed& packed, size_t first, size_t count,
+                         Visitor visit) {
+    for (size_t offset = 0; offset < count; offset += SIMD_MAX_WIDTH) {
+        uint32_t mask = intersects_packet(query, packed, first + offset);
+        if (count - offset < SIMD_MAX_WIDTH) {
+            mask &= (1u << (count - offset)) - 1;
+        }
+        while (mask) {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            visit(first + offset + lane);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,422 @@
+#include "../include/glm/glm.hpp"
+#include "bvh.hpp"
+#include "constants.hpp"
+#include "geometry.hpp"
+#include "intersection.hpp"
+#include "spatial_hash.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#ifndef intersection_state_hpp
+#define intersection_state_hpp
+
+// Erases the first copy of value from an unordered list
+void erase_value(std::vector<uint32_t>& values, uint32_t value) {
+    auto it = std::find(values.begin(), values.end(), value);
+    if (it != values.end()) {
+        *it = values.back();
+        values.pop_back();
+    }
+}
+
+// Keeps the hit pairs of a scene between edits so a change to one primitive only re-tests the
+// candidates the grids give for it. Lines and triangles are kept in spatial hashes, which are
+// cheap to edit in place. Colors are written back into the stores as pairs appear and disappear:
+// a primitive with hits is marked like mark_hit() does and one without gets back the colors it had
+// when the state was built or when it was added.
+//
+// The state holds references to the stores. Positions are edited in the stores directly and then
+// reported with update_line() / update_triangle(), while adding and removing has to go through the
+// state so the indices stay in sync. Removal moves the last primitive into the freed slot like
+// std::vector swap-and-pop.
+class IntersectionState {
+  public:
+    IntersectionState(TriangleStore& triangles, LineStore& lines)
+        : triangles(triangles), lines(lines), line_base_colors(), triangle_base_colors(),
+          line_hits(), triangle_hits(), line_boxes(), triangle_boxes(), line_grid(),
+          triangle_grid(), dirty_line_list(), dirty_triangle_list(), line_dirty(),
+          triangle_dirty(), hit_count(0), narrow_phase(NarrowPhase::SEGMENT), candidates() {}
+
+    // Snapshots the current colors as the unmarked ones and finds every hit pair from scratch
+    void build(const IntersectionConfig& config = default_intersection_config()) {
+        narrow_phase = config.narrow_phase;
+        line_base_colors.assign(lines.size() * LINE_VERTEX_COUNT, glm::vec3(0.0f));
+        for (size_t i = 0; i < lines.size(); i++) {
+            save_line_colors(i);
+        }
+        triangle_base_colors.assign(triangles.size() * TRI_VERTEX_COUNT, glm::vec3(0.0f));
+        for (size_t j = 0; j < triangles.size(); j++) {
+            save_triangle_colors(j);
+        }
+
+        line_boxes.resize(lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            line_boxes[i] = line_bounds(lines.a_pos[i], lines.b_pos[i]);
+        }
+        triangle_bounds(triangles, triangle_boxes);
+        line_grid.build(line_boxes);
+        triangle_grid.build(triangle_boxes);
+
+        line_hits.assign(lines.size(), std::vector<uint32_t>());
+        triangle_hits.assign(triangles.size(), std::vector<uint32_t>());
+        std::vector<HitPair> hits;
+        find_hits(triangles, lines, config, hits);
+        for (const auto& hit : hits) {
+            line_hits[hit.line].push_back(hit.triangle);
+            triangle_hits[hit.triangle].push_back(hit.line);
+        }
+        hit_count = hits.size();
+
+        line_dirty.assign(lines.size(), false);
+        triangle_dirty.assign(triangles.size(), false);
+        dirty_line_list.clear();
+        dirty_triangle_list.clear();
+        for (size_t i = 0; i < lines.size(); i++) {
+            apply_line_color(i);
+        }
+        for (size_t j = 0; j < triangles.size(); j++) {
+            apply_triangle_color(j);
+        }
+    }
+
+    // Re-tests line i after its positions changed
+    void update_line(uint32_t i) {
+        line_grid.remove(i, line_boxes[i]);
+        line_boxes[i] = line_bounds(lines.a_pos[i], lines.b_pos[i]);
+        line_grid.insert(i, line_boxes[i]);
+
+        std::vector<uint32_t> touched;
+        touched.swap(line_hits[i]);
+        for (auto j : touched) {
+            erase_value(triangle_hits[j], i);
+        }
+        hit_count -= touched.size();
+
+        find_candidates_for_line(i);
+        for (auto j : candidates) {
+            if (intersects(lines[i], triangles[j], narrow_phase)) {
+                add_hit(i, j);
+                touched.push_back(j);
+            }
+        }
+
+        mark_line_dirty(i);
+        apply_line_color(i);
+        for (auto j : touched) {
+            apply_triangle_color(j);
+        }
+    }
+
+    // Re-tests triangle j after its positions changed
+    void update_triangle(uint32_t j) {
+        triangle_grid.remove(j, triangle_boxes[j]);
+        triangle_boxes[j] =
+            triangle_bounds(triangles.a_pos[j], triangles.b_pos[j], triangles.c_pos[j]);
+        triangle_grid.insert(j, triangle_boxes[j]);
+
+        std::vector<uint32_t> touched;
+        touched.swap(triangle_hits[j]);
+        for (auto i : touched) {
+            erase_value(line_hits[i], j);
+        }
+        hit_count -= touched.size();
+
+        find_candidates_for_triangle(j);
+        for (auto i : candidates) {
+            if (intersects(lines[i], triangles[j], narrow_phase)) {
+                add_hit(i, j);
+                touched.push_back(i);
+            }
+        }
+
+        mark_triangle_dirty(j);
+        apply_triangle_color(j);
+        for (auto i : touched) {
+            apply_line_color(i);
+        }
+    }
+
+    // Takes over every hit pair from another broad phase after many positions were edited in
+    // place, such as a SweepAndPrune pass over an animated frame. Primitives whose boxes changed
+    // are re-binned and marked dirty and colors follow the new pairs. A move that keeps the box
+    // the same, like swapping the ends of a line, still has to be reported with update_line().
+    void sync_hits(const std::vector<HitPair>& hits) {
+        for (size_t i = 0; i < lines.size(); i++) {
+            AABB box = line_bounds(lines.a_pos[i], lines.b_pos[i]);
+            if (box.min != line_boxes[i].min || box.max != line_boxes[i].max) {
+                line_grid.remove(i, line_boxes[i]);
+                line_boxes[i] = box;
+                line_grid.insert(i, box);
+                mark_line_dirty(i);
+            }
+            line_hits[i].clear();
+        }
+        for (size_t j = 0; j < triangles.size(); j++) {
+            AABB box = triangle_bounds(triangles.a_pos[j], triangles.b_pos[j], triangles.c_pos[j]);
+            if (box.min != triangle_boxes[j].min || box.max != triangle_boxes[j].max) {
+                triangle_grid.remove(j, triangle_boxes[j]);
+                triangle_boxes[j] = box;
+                triangle_grid.insert(j, box);
+                mark_triangle_dirty(j);
+            }
+            triangle_hits[j].clear();
+        }
+
+        hit_count = 0;
+        for (const auto& hit : hits) {
+            add_hit(hit.line, hit.triangle);
+        }
+        for (size_t i = 0; i < lines.size(); i++) {
+            apply_line_color(i);
+        }
+        for (size_t j = 0; j < triangles.size(); j++) {
+            apply_triangle_color(j);
+        }
+    }
+
+    // Appends a line to the store and tests it, returning its index
+    uint32_t add_line(const Line& line) {
+        uint32_t i = lines.size();
+        lines.push_back(line);
+        line_base_colors.resize(lines.size() * LINE_VERTEX_COUNT);
+        save_line_colors(i);
+        line_hits.push_back(std::vector<uint32_t>());
+        line_boxes.push_back(line_bounds(line.a_pos, line.b_pos));
+        line_grid.insert(i, line_boxes[i]);
+        line_dirty.push_back(false);
+        update_line(i);
+        return i;
+    }
+
+    // Appends a triangle to the store and tests it, returning its index
+    uint32_t add_triangle(const Triangle& triangle) {
+        uint32_t j = triangles.size();
+        triangles.push_back(triangle);
+        triangle_base_colors.resize(triangles.size() * TRI_VERTEX_COUNT);
+        save_triangle_colors(j);
+        triangle_hits.push_back(std::vector<uint32_t>());
+        triangle_boxes.push_back(
+            triangle_bounds(triangle.a_pos, triangle.b_pos, triangle.c_pos));
+        triangle_grid.insert(j, triangle_boxes[j]);
+        triangle_dirty.push_back(false);
+        update_triangle(j);
+        return j;
+    }
+
+    // Removes line i, moving the last line into its slot
+    void remove_line(uint32_t i) {
+        line_grid.remove(i, line_boxes[i]);
+        for (auto j : line_hits[i]) {
+            erase_value(triangle_hits[j], i);
+            apply_triangle_color(j);
+        }
+        hit_count -= line_hits[i].size();
+
+        uint32_t last = lines.size() - 1;
+        if (i != last) {
+            line_grid.remove(last, line_boxes[last]);
+            line_grid.insert(i, line_boxes[last]);
+            for (auto j : line_hits[last]) {
+                std::replace(triangle_hits[j].begin(), triangle_hits[j].end(), last, i);
+            }
+            lines[i] = (Line)lines[last];
+            for (int k = 0; k < LINE_VERTEX_COUNT; k++) {
+                line_base_colors[i * LINE_VERTEX_COUNT + k] =
+                    line_base_colors[last * LINE_VERTEX_COUNT + k];
+            }
+            line_hits[i].swap(line_hits[last]);
+            line_boxes[i] = line_boxes[last];
+            mark_line_dirty(i);
+        }
+        lines.resize(last);
+        line_base_colors.resize(last * LINE_VERTEX_COUNT);
+        line_hits.pop_back();
+        line_boxes.pop_back();
+        drop_dirty(line_dirty, dirty_line_list, last);
+    }
+
+    // Removes triangle j, moving the last triangle into its slot
+    void remove_triangle(uint32_t j) {
+        triangle_grid.remove(j, triangle_boxes[j]);
+        for (auto i : triangle_hits[j]) {
+            erase_value(line_hits[i], j);
+            apply_line_color(i);
+        }
+        hit_count -= triangle_hits[j].size();
+
+        uint32_t last = triangles.size() - 1;
+        if (j != last) {
+            triangle_grid.remove(last, triangle_boxes[last]);
+            triangle_grid.insert(j, triangle_boxes[last]);
+            for (auto i : triangle_hits[last]) {
+                std::replace(line_hits[i].begin(), line_hits[i].end(), last, j);
+            }
+            triangles[j] = (Triangle)triangles[last];
+            for (int k = 0; k < TRI_VERTEX_COUNT; k++) {
+                triangle_base_colors[j * TRI_VERTEX_COUNT + k] =
+                    triangle_base_colors[last * TRI_VERTEX_COUNT + k];
+            }
+            triangle_hits[j].swap(triangle_hits[last]);
+            triangle_boxes[j] = triangle_boxes[last];
+            mark_triangle_dirty(j);
+        }
+        triangles.resize(last);
+        triangle_base_colors.resize(last * TRI_VERTEX_COUNT);
+        triangle_hits.pop_back();
+        triangle_boxes.pop_back();
+        drop_dirty(triangle_dirty, dirty_triangle_list, last);
+    }
+
+    size_t hits() const {
+        return hit_count;
+    }
+
+    const std::vector<uint32_t>& hits_of_line(uint32_t i) const {
+        return line_hits[i];
+    }
+
+    const std::vector<uint32_t>& hits_of_triangle(uint32_t j) const {
+        return triangle_hits[j];
+    }
+
+    // Primitives whose colors or positions changed since the last clear_dirty()
+    const std::vector<uint32_t>& dirty_lines() const {
+        return dirty_line_list;
+    }
+
+    const std::vector<uint32_t>& dirty_triangles() const {
+        return dirty_triangle_list;
+    }
+
+    void clear_dirty() {
+        for (auto i : dirty_line_list) {
+            line_dirty[i] = false;
+        }
+        for (auto j : dirty_triangle_list) {
+            triangle_dirty[j] = false;
+        }
+        dirty_line_list.clear();
+        dirty_triangle_list.clear();
+    }
+
+  private:
+    TriangleStore& triangles;
+    LineStore& lines;
+
+    // Colors of every vertex before marking
+    std::vector<glm::vec3> line_base_colors;
+    std::vector<glm::vec3> triangle_base_colors;
+
+    // Triangles hit by every line and lines hitting every triangle
+    std::vector<std::vector<uint32_t> > line_hits;
+    std::vector<std::vector<uint32_t> > triangle_hits;
+
+    // The boxes every primitive is binned with, needed to take it out of its grid again
+    std::vector<AABB> line_boxes;
+    std::vector<AABB> triangle_boxes;
+    SpatialHash line_grid;
+    SpatialHash triangle_grid;
+
+    std::vector<uint32_t> dirty_line_list;
+    std::vector<uint32_t> dirty_triangle_list;
+    std::vector<bool> line_dirty;
+    std::vector<bool> triangle_dirty;
+
+    size_t hit_count;
+    NarrowPhase narrow_phase;
+
+    // Scratch list of the primitives a query found, sorted without duplicates
+    std::vector<uint32_t> candidates;
+
+    IntersectionState(const IntersectionState&);
+    IntersectionState& operator=(const IntersectionState&);
+
+    void add_hit(uint32_t i, uint32_t j) {
+        line_hits[i].push_back(j);
+        triangle_hits[j].push_back(i);
+        hit_count++;
+    }
+
+    void find_candidates_for_line(uint32_t i) {
+        candidates.clear();
+        triangle_grid.query_segment(lines.a_pos[i], lines.b_pos[i],
+                                    [&](uint32_t j) { candidates.push_back(j); });
+        unique_candidates();
+    }
+
+    void find_candidates_for_triangle(uint32_t j) {
+        candidates.clear();
+        line_grid.query_box(triangle_boxes[j], [&](uint32_t i) {
+            if (overlaps(line_boxes[i], triangle_boxes[j])) {
+                candidates.push_back(i);
+            }
+        });
+        unique_candidates();
+    }
+
+    void unique_candidates() {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    void save_line_colors(uint32_t i) {
+        line_base_colors[i * LINE_VERTEX_COUNT] = lines.a_col[i];
+        line_base_colors[i * LINE_VERTEX_COUNT + 1] = lines.b_col[i];
+    }
+
+    void save_triangle_colors(uint32_t j) {
+        triangle_base_colors[j * TRI_VERTEX_COUNT] = triangles.a_col[j];
+        triangle_base_colors[j * TRI_VERTEX_COUNT + 1] = triangles.b_col[j];
+        triangle_base_colors[j * TRI_VERTEX_COUNT + 2] = triangles.c_col[j];
+    }
+
+    void apply_line_color(uint32_t i) {
+        bool hit = !line_hits[i].empty();
+        glm::vec3 a = hit ? RED_COLOR : line_base_colors[i * LINE_VERTEX_COUNT];
+        glm::vec3 b = hit ? RED_COLOR : line_base_colors[i * LINE_VERTEX_COUNT + 1];
+        if (lines.a_col[i] != a || lines.b_col[i] != b) {
+            lines.a_col[i] = a;
+            lines.b_col[i] = b;
+            mark_line_dirty(i);
+        }
+    }
+
+    void apply_triangle_color(uint32_t j) {
+        bool hit = !triangle_hits[j].empty();
+        glm::vec3 a = hit ? ORANGE_COLOR : triangle_base_colors[j * TRI_VERTEX_COUNT];
+        glm::vec3 b = hit ? ORANGE_COLOR : triangle_base_colors[j * TRI_VERTEX_COUNT + 1];
+        glm::vec3 c = hit ? ORANGE_COLOR : triangle_base_colors[j * TRI_VERTEX_COUNT + 2];
+        if (triangles.a_col[j] != a || triangles.b_col[j] != b || triangles.c_col[j] != c) {
+            triangles.a_col[j] = a;
+            triangles.b_col[j] = b;
+            triangles.c_col[j] = c;
+            mark_triangle_dirty(j);
+        }
+    }
+
+    void mark_line_dirty(uint32_t i) {
+        if (!line_dirty[i]) {
+            line_dirty[i] = true;
+            dirty_line_list.push_back(i);
+        }
+    }
+
+    void mark_triangle_dirty(uint32_t j) {
+        if (!triangle_dirty[j]) {
+            triangle_dirty[j] = true;
+            dirty_triangle_list.push_back(j);
+        }
+    }
+
+    // Forgets a slot that no longer exists after a removal
+    void drop_dirty(std::vector<bool>& flags, std::vector<uint32_t>& list, uint32_t last) {
+        if (flags[last]) {
+            list.erase(std::find(list.begin(), list.end(), last));
+        }
+        flags.pop_back();
+    }
+};
+
+#endif
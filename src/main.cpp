@@ -12,13 +12,27 @@
 #include "../include/shader.h"
 #include "camera.hpp"
 #include "constants.hpp"
+#include "culling.hpp"
+#include "draw_commands.hpp"
 #include "geometry.hpp"
+#include "instancing.hpp"
+#include "intersection.hpp"
+#include "intersection_state.hpp"
+#include "offscreen.hpp"
+#include "scene.hpp"
+#include "sweep_and_prune.hpp"
+#include "vertex_data.hpp"
 
 #include <array>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <math.h>
 #include <sstream>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #define ARRAY_COUNT(array)                                                                         \
@@ -36,153 +50,111 @@ GLuint vertex_buffer_object;
 GLuint index_buffer_object;
 GLuint vertex_array_object;
 
-// Shader
-Shader* shader;
+// Instanced mesh objects, only created with --instanced
+GLuint prototype_buffer_object;
+GLuint instance_buffer_object;
+GLuint instance_index_buffer_object;
+GLuint instance_vertex_array_object;
+GLuint instance_indirect_buffer_object; // the commands below, with indirect submission only
+DrawCommandList instanced_commands;     // one per prototype, rebuilt with the mesh
+
+// A shader and its uniform locations, resolved once so the render loop does no string lookups
+struct ShaderProgram {
+    Shader* shader;
+    GLint view_location;
+    GLint projection_location;
+    GLint model_location;
+};
+
+ShaderProgram mesh_program;
+ShaderProgram instanced_program;
+
+// Frustum culling of the packed mesh, off with --no-culling
+bool frustum_culling = true;
+DrawChunks draw_chunks;
+std::vector<DrawBatch> visible_batches;
+
+// How draw() hands its commands to the driver
+enum class DrawSubmission {
+    LOOP,       // one glDrawElementsBaseVertex per command
+    MULTI_DRAW, // one glMultiDrawElementsBaseVertex per run of commands
+    INDIRECT    // one glMultiDrawElementsIndirect per run, commands read from a buffer (GL 4.3)
+};
+
+// The preferred way, lowered by init_draw_submission() to what the context supports
+DrawSubmission draw_submission = DrawSubmission::INDIRECT;
+DrawCommandList draw_commands;
+GLuint indirect_buffer_object;
+
+// The loader only goes up to GL 4.1, so the 4.3 entry point is looked up by hand
+typedef void(APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type,
+                                                      const void* indirect, GLsizei drawcount,
+                                                      GLsizei stride);
+MultiDrawElementsIndirectProc multi_draw_elements_indirect = NULL;
+
+// What the last frame drew, shown in the window title
+struct FrameStats {
+    size_t draw_calls;
+    size_t commands;
+    size_t chunks_drawn;
+    size_t chunks_culled;
+};
+
+FrameStats frame_stats = {0, 0, 0, 0};
+FrameStats shown_frame_stats = {0, 0, 0, 0};
 
 // Time
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-void create_geometry(std::vector<Triangle>& triangles, std::vector<Line>& lines) {
-    triangles.push_back((Triangle){.a_pos = {0.0f, 0.0f, -1.0f},
-                                   .b_pos = {1.0f, 0.0f, -1.0f},
-                                   .c_pos = {0.0f, 1.0f, -1.0f},
-                                   .a_col = YELLOW_COLOR,
-                                   .b_col = YELLOW_COLOR,
-                                   .c_col = YELLOW_COLOR});
-    triangles.push_back((Triangle){.a_pos = {0.0f, 0.0f, -2.0f},
-                                   .b_pos = {1.0f, 0.0f, -2.0f},
-                                   .c_pos = {0.0f, 1.0f, -2.0f},
-                                   .a_col = YELLOW_COLOR,
-                                   .b_col = YELLOW_COLOR,
-                                   .c_col = YELLOW_COLOR});
-    lines.push_back((Line){.a_pos = {0.4f, 0.4f, 0.0f},
-                           .b_pos = {0.4f, 0.4f, -1.5f},
-                           .a_col = GREEN_COLOR,
-                           .b_col = GREEN_COLOR});
-    lines.push_back((Line){.a_pos = {0.0f, 2.0f, -3.0f},
-                           .b_pos = {2.0f, 0.0f, -1.0f},
-                           .a_col = GREEN_COLOR,
-                           .b_col = GREEN_COLOR});
-}
-
-void create_vertex_data(std::vector<Triangle>& triangles, std::vector<Line>& lines,
-                        std::vector<float>& vertex_data, std::vector<GLshort>& index_data) {
-    size_t index_count = 0;
-
-    // Add triangle vertex positions
-    for (auto triangle : triangles) {
-        vertex_data.push_back(triangle.a_pos.x);
-        vertex_data.push_back(triangle.a_pos.y);
-        vertex_data.push_back(triangle.a_pos.z);
-        index_data.push_back(index_count++);
-        vertex_data.push_back(triangle.b_pos.x);
-        vertex_data.push_back(triangle.b_pos.y);
-        vertex_data.push_back(triangle.b_pos.z);
-        index_data.push_back(index_count++);
-        vertex_data.push_back(triangle.c_pos.x);
-        vertex_data.push_back(triangle.c_pos.y);
-        vertex_data.push_back(triangle.c_pos.z);
-        index_data.push_back(index_count++);
-    }
-
-    // Add line vertex positions
-    for (auto line : lines) {
-        vertex_data.push_back(line.a_pos.x);
-        vertex_data.push_back(line.a_pos.y);
-        vertex_data.push_back(line.a_pos.z);
-        index_data.push_back(index_count++);
-        vertex_data.push_back(line.b_pos.x);
-        vertex_data.push_back(line.b_pos.y);
-        vertex_data.push_back(line.b_pos.z);
-        index_data.push_back(index_count++);
-    }
-
-    // Add triangle vertex colors
-    for (auto triangle : triangles) {
-        vertex_data.push_back(triangle.a_col.r);
-        vertex_data.push_back(triangle.a_col.g);
-        vertex_data.push_back(triangle.a_col.b);
-        vertex_data.push_back(triangle.b_col.r);
-        vertex_data.push_back(triangle.b_col.g);
-        vertex_data.push_back(triangle.b_col.b);
-        vertex_data.push_back(triangle.c_col.r);
-        vertex_data.push_back(triangle.c_col.g);
-        vertex_data.push_back(triangle.c_col.b);
-    }
-
-    // Add line vertex colors
-    for (auto line : lines) {
-        vertex_data.push_back(line.a_col.r);
-        vertex_data.push_back(line.a_col.g);
-        vertex_data.push_back(line.a_col.b);
-        vertex_data.push_back(line.b_col.r);
-        vertex_data.push_back(line.b_col.g);
-        vertex_data.push_back(line.b_col.b);
+// Puts the frame stats in the window title whenever they change
+void show_frame_stats() {
+    if (frame_stats.draw_calls == shown_frame_stats.draw_calls &&
+        frame_stats.commands == shown_frame_stats.commands &&
+        frame_stats.chunks_drawn == shown_frame_stats.chunks_drawn &&
+        frame_stats.chunks_culled == shown_frame_stats.chunks_culled) {
+        return;
     }
+    char title[160];
+    snprintf(title, sizeof(title),
+             "Jaragayt - %zu draw calls for %zu ranges, %zu chunks drawn, %zu culled",
+             frame_stats.draw_calls, frame_stats.commands, frame_stats.chunks_drawn,
+             frame_stats.chunks_culled);
+    glfwSetWindowTitle(window, title);
+    shown_frame_stats = frame_stats;
 }
 
-bool intersects(const Line& line, const Triangle& triangle) {
-    // We will find the point at which the ray intersects the plane defined by the triangle and then
-    // check if that point is within the triangle.
-
-    // To find the point at which the ray intersects the plane we will use the fact that the normal
-    // of the plane and a vector within the plane would be orthogonal (so their cross product would
-    // be 0). We will take the vector on the plane to be defined by one of the points of the
-    // triangle and the point at which the ray intersects the plane.
-    glm::vec3 n = glm::normalize(
-        glm::cross((triangle.b_pos - triangle.a_pos), (triangle.c_pos - triangle.b_pos)));
-
-    glm::vec3 p_tri = triangle.a_pos;
-
-    // We can define the ray with the equation a + d*t = p where p is a point in the ray
-    // a would be the start of the line, d the direction and p the point of intersection
-    glm::vec3 a = line.a_pos;
-    glm::vec3 b = line.b_pos;
-    glm::vec3 l = glm::normalize(line.b_pos - line.a_pos);
-
-    // If you put the ray equation inside the cross product mentioned above you can solve for t
-    float l_dot_n = glm::dot(l, n);
-    if (l_dot_n < TINY_NUMBER && l_dot_n > -TINY_NUMBER) {
-        return false;
+const char* draw_submission_name(DrawSubmission submission) {
+    switch (submission) {
+    case DrawSubmission::INDIRECT:
+        return "glMultiDrawElementsIndirect";
+    case DrawSubmission::MULTI_DRAW:
+        return "glMultiDrawElementsBaseVertex";
+    default:
+        return "glDrawElementsBaseVertex";
     }
-    float t = glm::dot(p_tri - a, n) / l_dot_n;
-
-    // Now we have the point in the plane
-    glm::vec3 p_ray = a + (t * l);
-
-    // If the point is not on the line then the reay doesn't intersect the plane
-    if (glm::length(b - a) - glm::length(p_ray - a) - glm::length(b - p_ray) < TINY_NUMBER ||
-        glm::length(b - a) - glm::length(p_ray - a) - glm::length(b - p_ray) > -TINY_NUMBER) {
-        return false;
-    }
-
-    // Check if the point on the plane is inside the triangle by checking if it's to the left of
-    // each side
-    if (is_left(glm::vec2(triangle.a_pos), glm::vec2(triangle.b_pos), glm::vec2(p_ray)) &&
-        is_left(glm::vec2(triangle.b_pos), glm::vec2(triangle.c_pos), glm::vec2(p_ray)) &&
-        is_left(glm::vec2(triangle.c_pos), glm::vec2(triangle.a_pos), glm::vec2(p_ray))) {
-        return true;
-    }
-
-    return false;
 }
 
-void mark_intersections(std::vector<Triangle>& triangles, std::vector<Line>& lines) {
-    for (auto& line : lines) {
-        for (auto& triangle : triangles) {
-            if (intersects(line, triangle)) {
-                line.a_col = glm::vec3(RED_COLOR);
-                line.b_col = glm::vec3(RED_COLOR);
-                triangle.a_col = glm::vec3(ORANGE_COLOR);
-                triangle.b_col = glm::vec3(ORANGE_COLOR);
-                triangle.c_col = glm::vec3(ORANGE_COLOR);
-            }
+// Lowers draw_submission to what the context can do
+void init_draw_submission() {
+    if (draw_submission == DrawSubmission::INDIRECT) {
+        if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3)) {
+            multi_draw_elements_indirect = (MultiDrawElementsIndirectProc)glfwGetProcAddress(
+                "glMultiDrawElementsIndirect");
+        }
+        if (multi_draw_elements_indirect != NULL) {
+            glGenBuffers(1, &indirect_buffer_object);
+        } else {
+            draw_submission = DrawSubmission::MULTI_DRAW;
         }
     }
+    if (draw_submission == DrawSubmission::MULTI_DRAW && glMultiDrawElementsBaseVertex == NULL) {
+        draw_submission = DrawSubmission::LOOP;
+    }
 }
 
-int init_program() {
+// Offscreen runs only need the context, so their window is never shown
+int init_program(bool visible) {
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -190,6 +162,7 @@ int init_program() {
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 
     // glfw window creation
     window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Jaragayt", NULL, NULL);
@@ -210,118 +183,640 @@ int init_program() {
     }
 
     glEnable(GL_DEPTH_TEST);
+    init_draw_submission();
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (visible) {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     return 0;
 }
 
-void init_vertices(std::vector<float>& vertex_data_in, std::vector<GLshort>& index_data_in,
-                   size_t triangle_count, size_t line_count) {
-    // Generate c style arrays
-    float vertex_data[vertex_data_in.size()];
-    for (size_t i = 0; i < vertex_data_in.size(); i++) {
-        vertex_data[i] = vertex_data_in[i];
+// Bytes handed to the driver. Every upload passes a pointer into the mesh's own vectors, so
+// there are no host-side copies to count.
+struct UploadStats {
+    size_t bytes_uploaded;
+};
+
+UploadStats upload_stats = {0};
+
+// Uploads straight from the caller's storage, nothing is staged on the way. A null data pointer
+// only allocates the buffer for glBufferSubData to fill in.
+void upload_buffer(GLenum target, GLuint buffer, const void* data, size_t size, GLenum usage) {
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, usage);
+    glBindBuffer(target, 0);
+    if (data != NULL) {
+        upload_stats.bytes_uploaded += size;
     }
+}
 
-    GLshort index_data[index_data_in.size()];
-    for (size_t i = 0; i < index_data_in.size(); i++) {
-        index_data[i] = index_data_in[i];
-    }
+GLenum gl_primitive(PrimitiveType primitive) {
+    return primitive == PrimitiveType::TRIANGLES ? GL_TRIANGLES : GL_LINES;
+}
 
-    // Variables
-    int vertex_count = (triangle_count * TRI_VERTEX_COUNT) + (line_count * LINE_VERTEX_COUNT);
-    int line_index_offset = triangle_count;
+GLenum gl_index_type(IndexType index_type) {
+    return index_type == IndexType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
 
-    // Bind and generate buffers
-    glGenBuffers(1, &vertex_buffer_object);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_data), vertex_data, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+GLenum gl_component_type(ComponentType type) {
+    switch (type) {
+    case ComponentType::HALF_FLOAT:
+        return GL_HALF_FLOAT;
+    case ComponentType::SHORT:
+        return GL_SHORT;
+    case ComponentType::UNSIGNED_BYTE:
+        return GL_UNSIGNED_BYTE;
+    default:
+        return GL_FLOAT;
+    }
+}
 
-    glGenBuffers(1, &index_buffer_object);
+// Uploads the whole mesh and points the vertex array at it, also used when it has to be rebuilt
+void upload_mesh(const MeshData& mesh) {
+    // Vertices are patched in place when intersection colors change (see sync_vertex_data)
+    upload_buffer(GL_ARRAY_BUFFER, vertex_buffer_object, mesh.vertex_data.data(),
+                  mesh.vertex_data.size(), GL_DYNAMIC_DRAW);
 
+    // 16-bit indices go first and 32-bit ones after them
+    upload_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_object, NULL, index_data_size(mesh),
+                  GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_object);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_data), index_data, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh.indices16.size() * sizeof(uint16_t),
+                    mesh.indices16.data());
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index32_byte_offset(mesh),
+                    mesh.indices32.size() * sizeof(uint32_t), mesh.indices32.data());
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    upload_stats.bytes_uploaded += mesh.indices16.size() * sizeof(uint16_t);
+    upload_stats.bytes_uploaded += mesh.indices32.size() * sizeof(uint32_t);
 
     // Vertex array object
-    glGenVertexArrays(1, &vertex_array_object);
     glBindVertexArray(vertex_array_object);
 
-    size_t color_data_offset = sizeof(float) * POS_ELEM_COUNT * vertex_count;
+    const VertexLayout& layout = mesh.layout;
     glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(0,              // attribute 0 in shader
-                          POS_ELEM_COUNT, // size
-                          GL_FLOAT,       // type
-                          GL_FALSE,       // normalized?
-                          0,              // stride
-                          (void*)0        // array buffer offset
+    glVertexAttribPointer(0,                                       // attribute 0 in shader
+                          layout.position.components,              // size
+                          gl_component_type(layout.position.type), // type
+                          layout.position.normalized,              // normalized?
+                          layout.position.stride,                  // stride
+                          (void*)layout.position.offset            // array buffer offset
     );
-    glVertexAttribPointer(1,                       // atrtribute 1 in shader
-                          COL_ELEM_COUNT,          // size
-                          GL_FLOAT,                // type
-                          GL_FALSE,                // normalized?
-                          0,                       // stride
-                          (void*)color_data_offset // array buffer offset
+    glVertexAttribPointer(1,                                    // atrtribute 1 in shader
+                          layout.color.components,              // size
+                          gl_component_type(layout.color.type), // type
+                          layout.color.normalized,              // normalized?
+                          layout.color.stride,                  // stride
+                          (void*)layout.color.offset            // array buffer offset
     );
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_object);
 
     glBindVertexArray(0);
 }
 
+void init_vertices(const MeshData& mesh) {
+    glGenBuffers(1, &vertex_buffer_object);
+    glGenBuffers(1, &index_buffer_object);
+    glGenVertexArrays(1, &vertex_array_object);
+    upload_mesh(mesh);
+}
+
+// Sends only the changed byte ranges of data to a vertex buffer holding all of it
+void flush_buffer_ranges(GLuint buffer, const uint8_t* data, DirtyRanges& dirty) {
+    coalesce_dirty_ranges(dirty);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (const auto& range : dirty.ranges) {
+        glBufferSubData(GL_ARRAY_BUFFER, range.first, range.second - range.first,
+                        data + range.first);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    upload_stats.bytes_uploaded += dirty_bytes(dirty);
+    dirty.ranges.clear();
+}
+
+void flush_vertex_data(const MeshData& mesh, DirtyRanges& dirty) {
+    flush_buffer_ranges(vertex_buffer_object, mesh.vertex_data.data(), dirty);
+}
+
+// What sync_vertex_data() had to do
+enum class VertexSync {
+    NONE,    // nothing changed
+    PATCHED, // the changed vertices were rewritten in place
+    REBUILT  // the whole mesh was created and uploaded again
+};
+
+// Brings the GPU copy of the mesh up to date with what the intersection state changed, patching
+// the changed vertices when possible and rebuilding everything otherwise
+VertexSync sync_vertex_data(GeometryStore& geometry, IntersectionState& state, MeshData& mesh,
+                            const VertexDataConfig& config) {
+    if (state.dirty_lines().empty() && state.dirty_triangles().empty()) {
+        return VertexSync::NONE;
+    }
+    DirtyRanges dirty;
+    VertexSync sync = VertexSync::PATCHED;
+    if (update_vertex_data(geometry.triangles, geometry.lines, state.dirty_triangles(),
+                           state.dirty_lines(), mesh, dirty)) {
+        flush_vertex_data(mesh, dirty);
+    } else {
+        create_vertex_data(geometry.triangles, geometry.lines, mesh, config);
+        upload_mesh(mesh);
+        sync = VertexSync::REBUILT;
+    }
+    state.clear_dirty();
+    return sync;
+}
+
+// Uploads the prototypes and instances and points the instanced vertex array at them
+void upload_instanced_mesh(const InstancedMesh& mesh) {
+    upload_buffer(GL_ARRAY_BUFFER, prototype_buffer_object, mesh.vertices.data(),
+                  mesh.vertices.size() * sizeof(PrototypeVertex), GL_STATIC_DRAW);
+    upload_buffer(GL_ELEMENT_ARRAY_BUFFER, instance_index_buffer_object, mesh.indices.data(),
+                  mesh.indices.size() * sizeof(uint16_t), GL_STATIC_DRAW);
+    // Instances are patched in place when lines move or colors change (see sync_instanced_mesh)
+    upload_buffer(GL_ARRAY_BUFFER, instance_buffer_object, mesh.instances.data(),
+                  mesh.instances.size() * sizeof(InstanceAttributes), GL_DYNAMIC_DRAW);
+    // Prototypes only change when the mesh is rebuilt, so their commands are uploaded with it
+    build_instanced_draw_commands(mesh, instanced_commands);
+    if (draw_submission == DrawSubmission::INDIRECT) {
+        upload_buffer(GL_DRAW_INDIRECT_BUFFER, instance_indirect_buffer_object,
+                      instanced_commands.commands.data(),
+                      instanced_commands.commands.size() * sizeof(DrawCommand), GL_STATIC_DRAW);
+    }
+
+    glBindVertexArray(instance_vertex_array_object);
+    glBindBuffer(GL_ARRAY_BUFFER, prototype_buffer_object);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PrototypeVertex),
+                          (void*)offsetof(PrototypeVertex, position));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PrototypeVertex),
+                          (void*)offsetof(PrototypeVertex, color));
+
+    // Advanced once per instance, pointed at each batch's instances when drawing
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribDivisor(3, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, instance_index_buffer_object);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void init_instanced_vertices(const InstancedMesh& mesh) {
+    glGenBuffers(1, &prototype_buffer_object);
+    glGenBuffers(1, &instance_buffer_object);
+    glGenBuffers(1, &instance_index_buffer_object);
+    glGenVertexArrays(1, &instance_vertex_array_object);
+    if (draw_submission == DrawSubmission::INDIRECT) {
+        glGenBuffers(1, &instance_indirect_buffer_object);
+    }
+    upload_instanced_mesh(mesh);
+}
+
+// Like sync_vertex_data, for the instanced mesh
+void sync_instanced_mesh(GeometryStore& geometry, IntersectionState& state, InstancedMesh& mesh) {
+    if (state.dirty_lines().empty() && state.dirty_triangles().empty()) {
+        return;
+    }
+    DirtyRanges dirty;
+    if (update_instances(geometry.triangles, geometry.lines, state.dirty_triangles(),
+                         state.dirty_lines(), mesh, dirty)) {
+        flush_buffer_ranges(instance_buffer_object, (const uint8_t*)mesh.instances.data(), dirty);
+    } else {
+        create_instanced_mesh(geometry.triangles, geometry.lines, mesh);
+        upload_instanced_mesh(mesh);
+    }
+    state.clear_dirty();
+}
+
+ShaderProgram load_program(const char* vertex_path, const char* fragment_path) {
+    ShaderProgram program;
+    program.shader = new Shader(vertex_path, fragment_path);
+    program.view_location = program.shader->getUniformLocation("view");
+    program.projection_location = program.shader->getUniformLocation("projection");
+    program.model_location = program.shader->getUniformLocation("model");
+    return program;
+}
+
 // Initalize shaders
 void init_shaders() {
-    shader = new Shader("assets/shaders/vert.glsl", "assets/shaders/frag.glsl");
-    shader->use();
+    mesh_program = load_program("assets/shaders/vert.glsl", "assets/shaders/frag.glsl");
+    instanced_program =
+        load_program("assets/shaders/instanced_vert.glsl", "assets/shaders/frag.glsl");
 }
 
-void draw(size_t triangle_count, size_t line_count) {
-    uint triangle_vertex_count = triangle_count * TRI_VERTEX_COUNT;
-    uint line_vertex_count = line_count * LINE_VERTEX_COUNT;
-    uint line_index_offset = triangle_count * TRI_VERTEX_COUNT;
-
+// Draws the given batches of the mesh, all of mesh.batches or the part of them culling kept.
+// They go through one command list, so batches of the same primitive and index type take a single
+// draw call unless draw_submission is LOOP.
+void draw(const MeshData& mesh, const std::vector<DrawBatch>& batches) {
+    build_draw_commands(mesh, batches, draw_commands);
+    frame_stats.commands += draw_commands.commands.size();
+    if (draw_commands.commands.empty()) {
+        return;
+    }
     glBindVertexArray(vertex_array_object);
 
-    // Draw triangles
-    glDrawElements(GL_TRIANGLES, triangle_vertex_count, GL_UNSIGNED_SHORT, 0);
+    // Triangle batches come before line batches
+    if (draw_submission == DrawSubmission::INDIRECT) {
+        // Reallocated every frame so the driver never waits for last frame's commands
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_object);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, draw_commands.commands.size() * sizeof(DrawCommand),
+                     draw_commands.commands.data(), GL_STREAM_DRAW);
+        for (const auto& run : draw_commands.runs) {
+            multi_draw_elements_indirect(gl_primitive(run.primitive), gl_index_type(run.index_type),
+                                         (void*)(run.first * sizeof(DrawCommand)), run.count,
+                                         sizeof(DrawCommand));
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        frame_stats.draw_calls += draw_commands.runs.size();
+    } else if (draw_submission == DrawSubmission::MULTI_DRAW) {
+        for (const auto& run : draw_commands.runs) {
+            glMultiDrawElementsBaseVertex(gl_primitive(run.primitive),
+                                          draw_commands.counts.data() + run.first,
+                                          gl_index_type(run.index_type),
+                                          draw_commands.offsets.data() + run.first, run.count,
+                                          draw_commands.base_vertices.data() + run.first);
+        }
+        frame_stats.draw_calls += draw_commands.runs.size();
+    } else {
+        for (const auto& run : draw_commands.runs) {
+            for (size_t k = run.first; k < run.first + run.count; k++) {
+                glDrawElementsBaseVertex(gl_primitive(run.primitive), draw_commands.counts[k],
+                                         gl_index_type(run.index_type), draw_commands.offsets[k],
+                                         draw_commands.base_vertices[k]);
+            }
+        }
+        frame_stats.draw_calls += draw_commands.commands.size();
+    }
+}
 
-    // Draw lines
-    glDrawElementsBaseVertex(GL_LINES, line_vertex_count, GL_UNSIGNED_SHORT, 0, line_index_offset);
+// Draws every prototype once per instance. With indirect submission the commands carry each
+// prototype's first instance, so all triangle prototypes take one call and all line prototypes
+// another. GL 3.3 has no base instance and no instanced multi-draw, so otherwise the instance
+// attributes are pointed at the first instance of each batch and every prototype is its own call.
+void draw_instanced(const InstancedMesh& mesh) {
+    glBindVertexArray(instance_vertex_array_object);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object);
+    frame_stats.commands += instanced_commands.commands.size();
+    if (draw_submission == DrawSubmission::INDIRECT) {
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                              (void*)offsetof(InstanceAttributes, offset));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                              (void*)offsetof(InstanceAttributes, color));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instance_indirect_buffer_object);
+        for (const auto& run : instanced_commands.runs) {
+            multi_draw_elements_indirect(gl_primitive(run.primitive), GL_UNSIGNED_SHORT,
+                                         (void*)(run.first * sizeof(DrawCommand)), run.count,
+                                         sizeof(DrawCommand));
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        frame_stats.draw_calls += instanced_commands.runs.size();
+        return;
+    }
+    for (const auto& batch : mesh.batches) {
+        size_t first = batch.first_instance * sizeof(InstanceAttributes);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                              (void*)(first + offsetof(InstanceAttributes, offset)));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+                              (void*)(first + offsetof(InstanceAttributes, color)));
+        glDrawElementsInstancedBaseVertex(gl_primitive(batch.primitive), batch.count,
+                                          GL_UNSIGNED_SHORT,
+                                          (void*)(batch.first * sizeof(uint16_t)),
+                                          batch.instance_count, batch.base_vertex);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    frame_stats.draw_calls += mesh.batches.size();
 }
 
-void view_projection_model() {
+void view_projection_model(const ShaderProgram& program, const glm::mat4& view,
+                           const glm::mat4& projection, const glm::mat4& model) {
     // activate shader
-    shader->use();
+    program.shader->use();
 
     // camera/view transformation
-    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-    shader->setMat4("view", view);
+    program.shader->setMat4(program.view_location, view);
 
     // projection
-    glm::mat4 projection =
-        glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    shader->setMat4("projection", projection);
+    program.shader->setMat4(program.projection_location, projection);
 
     // model
-    glm::mat4 model = glm::mat4(1.0f);
-    shader->setMat4("model", model);
+    program.shader->setMat4(program.model_location, model);
+}
+
+// Draws the instanced mesh when there is one and the packed mesh otherwise
+void draw_scene(const MeshData& mesh, const InstancedMesh* instanced, const glm::mat4& view,
+                const glm::mat4& projection) {
+    if (instanced != NULL) {
+        view_projection_model(instanced_program, view, projection, glm::mat4(1.0f));
+        draw_instanced(*instanced);
+    } else {
+        // The model matrix also undoes position quantization
+        glm::mat4 model = mesh.layout.dequantize;
+        view_projection_model(mesh_program, view, projection, model);
+        if (frustum_culling) {
+            CullStats cull_stats;
+            cull_chunks(mesh, draw_chunks, projection * view * model, visible_batches,
+                        cull_stats);
+            frame_stats.chunks_drawn = cull_stats.drawn;
+            frame_stats.chunks_culled = cull_stats.culled;
+            draw(mesh, visible_batches);
+        } else {
+            draw(mesh, mesh.batches);
+        }
+    }
+}
+
+// Renders an offscreen run into a framebuffer object. Frames are read back into two pixel buffers
+// in turn and each one is mapped a frame later, once the next frame has been queued behind its
+// copy, so neither glReadPixels nor the map waits for the GPU to drain. Returns the seconds spent
+// rendering and reading back, not counting time blocked on the encoder, or a negative number if
+// the framebuffer can't be created.
+double render_offscreen_gl(const MeshData& mesh, const InstancedMesh* instanced,
+                           const OffscreenSettings& settings, FrameEncoder& encoder) {
+    GLuint framebuffer;
+    GLuint renderbuffers[2]; // color and depth
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, settings.width, settings.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, settings.width, settings.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                              renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Failed to create the offscreen framebuffer" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        return -1.0;
+    }
+
+    size_t frame_bytes = (size_t)settings.width * settings.height * 4;
+    GLuint pixel_buffers[2];
+    glGenBuffers(2, pixel_buffers);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glViewport(0, 0, settings.width, settings.height);
+    glm::mat4 projection =
+        scene_projection(settings.fov, (float)settings.width / settings.height);
+    ExportFrame frame;
+    double render_seconds = 0.0;
+    for (size_t n = 0; n <= settings.frame_count; n++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (n < settings.frame_count) {
+            glClearColor(CLEAR_COLOR, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            draw_scene(mesh, instanced,
+                       orbit_view(n, settings.frame_count, settings.orbit_radius), projection);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[n % 2]);
+            glReadPixels(0, 0, settings.width, settings.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                         (void*)0);
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        // The previous frame, which the GPU has had this whole frame to copy out
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[(n - 1) % 2]);
+        const uint8_t* pixels =
+            (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes, GL_MAP_READ_BIT);
+        frame.width = settings.width;
+        frame.height = settings.height;
+        frame.bottom_up = true;
+        frame.path = frame_path(settings.output, n - 1);
+        if (pixels != NULL) {
+            frame.rgba.assign(pixels, pixels + frame_bytes);
+        } else {
+            frame.rgba.assign(frame_bytes, 0);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        render_seconds +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        encoder.submit(frame);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteBuffers(2, pixel_buffers);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+    return render_seconds;
 }
 
-int main() {
-    init_program();
-    init_shaders();
+// Waits for the encoder and reports how the run went
+void finish_offscreen(const OffscreenSettings& settings, FrameEncoder& encoder,
+                      double render_seconds) {
+    encoder.finish();
+    std::cout << "Rendered " << settings.frame_count << " frames at " << settings.width << "x"
+              << settings.height << ", " << render_seconds * 1000.0 / settings.frame_count
+              << " ms per frame, " << encoder.blocked_seconds() * 1000.0
+              << " ms waiting on the encoder" << std::endl;
+    std::cout << "Wrote " << encoder.written() << " frames, " << encoder.bytes() << " bytes to "
+              << settings.output << "_*.ppm";
+    if (encoder.failed() > 0) {
+        std::cout << ", " << encoder.failed() << " frames failed to write";
+    }
+    std::cout << std::endl;
+}
 
-    std::vector<Triangle> triangles;
-    std::vector<Line> lines;
-    std::vector<float> vertex_data;
-    std::vector<GLshort> index_data;
-    create_geometry(triangles, lines);
-    mark_intersections(triangles, lines);
-    create_vertex_data(triangles, lines, vertex_data, index_data);
-    init_vertices(vertex_data, index_data, triangles.size(), lines.size());
+int main(int argc, char** argv) {
+    // Intersection settings
+    IntersectionConfig intersection_config = default_intersection_config();
+    intersection_config.thread_count = default_thread_count();
+    VertexDataConfig vertex_data_config = default_vertex_data_config();
+    bool self_intersections = false;
+    float clearance = 0.0f;
+    bool animate = false;
+    // Offscreen rendering, off unless a frame count is given
+    OffscreenSettings offscreen = (OffscreenSettings){.width = SCR_WIDTH,
+                                                      .height = SCR_HEIGHT,
+                                                      .frame_count = 0,
+                                                      .fov = fov,
+                                                      .orbit_radius = glm::length(cameraPos),
+                                                      .output = "frame",
+                                                      .thread_count = 0};
+    bool software = false;
+    bool instancing = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--brute-force") == 0) {
+            intersection_config.mode = IntersectionMode::BRUTE_FORCE;
+        } else if (strcmp(argv[i], "--exact") == 0) {
+            intersection_config.narrow_phase = NarrowPhase::EXACT;
+        } else if (strcmp(argv[i], "--legacy-intersection") == 0) {
+            intersection_config.narrow_phase = NarrowPhase::LEGACY;
+        } else if (strcmp(argv[i], "--grid") == 0) {
+            intersection_config.mode = IntersectionMode::GRID;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            intersection_config.thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--self-intersections") == 0) {
+            self_intersections = true;
+        } else if (strcmp(argv[i], "--clearance") == 0 && i + 1 < argc) {
+            clearance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--animate") == 0) {
+            animate = true;
+        } else if (strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc) {
+            int frame_count = atoi(argv[++i]);
+            if (frame_count <= 0) {
+                std::cout << "Invalid frame count \"" << argv[i] << "\"\n"
+                          << "usage: --offscreen N with N > 0" << std::endl;
+                return -1;
+            }
+            offscreen.frame_count = frame_count;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            offscreen.output = argv[++i];
+        } else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &offscreen.width, &offscreen.height) != 2 ||
+                offscreen.width <= 0 || offscreen.height <= 0) {
+                std::cout << "Invalid resolution \"" << argv[i] << "\"\n"
+                          << "usage: --resolution WxH with W, H > 0" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--software") == 0) {
+            software = true;
+        } else if (strcmp(argv[i], "--submission") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "loop") == 0) {
+                draw_submission = DrawSubmission::LOOP;
+            } else if (strcmp(argv[i], "multi") == 0) {
+                draw_submission = DrawSubmission::MULTI_DRAW;
+            } else if (strcmp(argv[i], "indirect") == 0) {
+                draw_submission = DrawSubmission::INDIRECT;
+            } else {
+                std::cout << "Unknown submission \"" << argv[i] << "\"\n"
+                          << "usage: --submission loop|multi|indirect" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-culling") == 0) {
+            frustum_culling = false;
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            instancing = true;
+        } else if (strcmp(argv[i], "--no-weld") == 0) {
+            vertex_data_config.weld = false;
+        } else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "interleaved") == 0) {
+                vertex_data_config.format = INTERLEAVED_FORMAT;
+            } else if (strcmp(argv[i], "packed") == 0) {
+                vertex_data_config.format = PACKED_FORMAT;
+            } else if (strcmp(argv[i], "quantized") == 0) {
+                vertex_data_config.format = QUANTIZED_FORMAT;
+            } else if (strcmp(argv[i], "planar") == 0) {
+                vertex_data_config.format = PLANAR_FORMAT;
+            } else {
+                std::cout << "Unknown vertex format \"" << argv[i] << "\"\n"
+                          << "usage: --vertex-format planar|interleaved|packed|quantized"
+                          << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    // Animated lines recolor the triangles they pass through every frame. Welded corners are
+    // shared with neighbours, so those triangles can only be patched in place without welding.
+    if (animate) {
+        vertex_data_config.weld = false;
+    }
+
+    // The CPU rasterizer needs no context at all
+    offscreen.thread_count = intersection_config.thread_count;
+    bool software_offscreen = offscreen.frame_count > 0 && software;
+    if (!software_offscreen) {
+        init_program(offscreen.frame_count == 0);
+        init_shaders();
+        std::cout << "Drawing with " << draw_submission_name(draw_submission) << std::endl;
+    }
+
+    GeometryStore geometry;
+    MeshData mesh;
+    create_geometry(geometry.triangles, geometry.lines);
+    // Neighbours in the stores end up drawn together, so each culling chunk covers a small area
+    sort_spatially(geometry.triangles, geometry.lines);
+    if (self_intersections) {
+        // Part of the base colors, so line hits are drawn over them and restored back to them
+        std::vector<TrianglePair> overlaps;
+        find_triangle_overlaps(geometry.triangles, intersection_config, overlaps);
+        mark_triangle_overlaps(overlaps, geometry.triangles);
+        std::cout << "Found " << overlaps.size() << " overlapping triangle pairs" << std::endl;
+    }
+    if (clearance > 0.0f) {
+        std::vector<LinePair> close_lines;
+        find_close_lines(geometry.lines, clearance, intersection_config, close_lines);
+        mark_close_lines(close_lines, geometry.lines);
+        std::cout << "Found " << close_lines.size() << " line pairs closer than " << clearance
+                  << std::endl;
+    }
+    IntersectionState intersections(geometry.triangles, geometry.lines);
+    intersections.build(intersection_config);
+    intersections.clear_dirty();
+    // Animated lines are re-tested every frame through a sweep kept sorted between frames
+    LineStore rest_lines = geometry.lines;
+    SweepAndPrune sweep;
+    std::vector<HitPair> frame_hits;
+    if (animate) {
+        sweep.build(geometry.triangles, geometry.lines);
+    }
+    create_vertex_data(geometry.triangles, geometry.lines, mesh, vertex_data_config);
+    std::cout << "Welded " << mesh.stats.corner_count << " triangle corners into "
+              << mesh.stats.triangle_vertex_count << " vertices, ACMR "
+              << mesh.stats.acmr_before << " -> " << mesh.stats.acmr_after << std::endl;
+    std::cout << mesh.layout.bytes_per_vertex << " bytes per vertex, "
+              << mesh.vertex_data.size() << " bytes of vertex data" << std::endl;
+    if (software_offscreen) {
+        FrameEncoder encoder;
+        double render_seconds = render_offscreen_software(mesh, offscreen, encoder);
+        finish_offscreen(offscreen, encoder, render_seconds);
+        return 0;
+    }
+    InstancedMesh instanced;
+    if (instancing) {
+        create_instanced_mesh(geometry.triangles, geometry.lines, instanced);
+        std::cout << "Instanced " << instanced.instances.size() << " primitives from "
+                  << instanced.batches.size() << " prototypes, "
+                  << instanced_mesh_bytes(instanced) << " bytes" << std::endl;
+        size_t packed_bytes = mesh.vertex_data.size() + index_data_size(mesh);
+        if (!instancing_pays_off(instanced, packed_bytes)) {
+            std::cout << "Too few repeated primitives to instance (" << packed_bytes
+                      << " bytes packed), drawing the packed mesh instead" << std::endl;
+            instancing = false;
+        }
+    }
+    if (instancing) {
+        init_instanced_vertices(instanced);
+    } else {
+        init_vertices(mesh);
+        build_draw_chunks(mesh, draw_chunks);
+    }
+    std::cout << "Uploaded " << upload_stats.bytes_uploaded << " bytes" << std::endl;
+    const InstancedMesh* instanced_scene = instancing ? &instanced : NULL;
+    if (offscreen.frame_count > 0) {
+        FrameEncoder encoder;
+        frame_stats = (FrameStats){0, 0, 0, 0};
+        double render_seconds = render_offscreen_gl(mesh, instanced_scene, offscreen, encoder);
+        if (render_seconds >= 0.0) {
+            finish_offscreen(offscreen, encoder, render_seconds);
+            std::cout << (double)frame_stats.draw_calls / offscreen.frame_count
+                      << " draw calls per frame for "
+                      << (double)frame_stats.commands / offscreen.frame_count << " ranges"
+                      << std::endl;
+        }
+        delete mesh_program.shader;
+        delete instanced_program.shader;
+        glfwTerminate();
+        return render_seconds >= 0.0 ? 0 : -1;
+    }
 
     // render loop
     while (!glfwWindowShouldClose(window)) {
@@ -332,21 +827,43 @@ int main() {
 
         processInput(window);
 
+        if (animate) {
+            animate_lines(rest_lines, currentFrame, geometry.lines);
+            sweep.update(geometry.triangles, geometry.lines);
+            sweep.find_hits(geometry.triangles, geometry.lines, intersection_config.narrow_phase,
+                            frame_hits);
+            intersections.sync_hits(frame_hits);
+        }
+
         // render
         glClearColor(CLEAR_COLOR, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // render
-        view_projection_model();
-        draw(triangles.size(), lines.size());
+        if (instancing) {
+            sync_instanced_mesh(geometry, intersections, instanced);
+        } else {
+            VertexSync sync = sync_vertex_data(geometry, intersections, mesh, vertex_data_config);
+            if (sync == VertexSync::REBUILT) {
+                build_draw_chunks(mesh, draw_chunks);
+            } else if (sync == VertexSync::PATCHED && animate) {
+                // Only the lines move, triangles just change color
+                refresh_draw_chunks(mesh, draw_chunks, PrimitiveType::LINES);
+            }
+        }
+        frame_stats = (FrameStats){0, 0, 0, 0};
+        draw_scene(mesh, instanced_scene, glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp),
+                   scene_projection(fov, (float)SCR_WIDTH / (float)SCR_HEIGHT));
+        show_frame_stats();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    // deallocated shader
-    delete shader;
+    // deallocated shaders
+    delete mesh_program.shader;
+    delete instanced_program.shader;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwTerminate();
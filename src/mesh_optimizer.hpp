@@ -0,0 +1,254 @@
+#include "../include/glm/glm.hpp"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#ifndef mesh_optimizer_hpp
+#define mesh_optimizer_hpp
+
+// Cache the vertex cache optimizer scores against (Forsyth's LRU model)
+const int FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_SCALE = 2.0f;
+const float FORSYTH_VALENCE_POWER = 0.5f;
+
+// Cache used to report ACMR, a small FIFO like the post-transform caches of most GPUs
+const size_t ACMR_CACHE_SIZE = 16;
+
+struct WeldKey {
+    int64_t v[6];
+
+    bool operator==(const WeldKey& other) const {
+        return memcmp(v, other.v, sizeof(v)) == 0;
+    }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& key) const {
+        uint64_t h = 1469598103934665603ull;
+        for (int i = 0; i < 6; i++) {
+            h = (h ^ (uint64_t)key.v[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+// Grid cells further out than this from the origin are keyed on exact bits instead
+const double WELD_MAX_CELL = 4611686018427387904.0; // 2^62
+
+// Snaps a value to a grid of the given spacing, or keeps its exact bits when the spacing is 0. The
+// cell is computed in double and kept in 64 bits, so a 1e-6 grid still tells apart neighbouring
+// floats thousands of units out. Values too far out for the grid (or not finite) are keyed on
+// their bits below every grid cell, so they only weld with themselves.
+int64_t weld_coordinate(float value, float epsilon) {
+    value += 0.0f; // -0 and +0 are the same vertex
+    if (epsilon > 0.0f) {
+        double cell = floor((double)value / epsilon + 0.5);
+        if (fabs(cell) < WELD_MAX_CELL) {
+            return (int64_t)cell;
+        }
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return epsilon > 0.0f ? INT64_MIN + bits : (int64_t)bits;
+}
+
+// Merges corners whose position and color agree to within epsilon. The first corner of every group
+// becomes the shared vertex and indices has one entry per input corner.
+void weld_vertices(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& colors,
+                   float epsilon, std::vector<glm::vec3>& out_positions,
+                   std::vector<glm::vec3>& out_colors, std::vector<uint32_t>& indices) {
+    std::unordered_map<WeldKey, uint32_t, WeldKeyHash> vertices;
+    vertices.reserve(positions.size());
+    out_positions.clear();
+    out_colors.clear();
+    indices.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        WeldKey key;
+        for (int j = 0; j < 3; j++) {
+            key.v[j] = weld_coordinate(positions[i][j], epsilon);
+            key.v[3 + j] = weld_coordinate(colors[i][j], epsilon);
+        }
+        auto inserted = vertices.insert(std::make_pair(key, (uint32_t)out_positions.size()));
+        if (inserted.second) {
+            out_positions.push_back(positions[i]);
+            out_colors.push_back(colors[i]);
+        }
+        indices[i] = inserted.first->second;
+    }
+}
+
+// Average number of vertices transformed per triangle when drawing a triangle list through a FIFO
+// cache, between 0.5 (ideal) and 3 (no reuse)
+float compute_acmr(const std::vector<uint32_t>& indices, size_t vertex_count,
+                   size_t cache_size = ACMR_CACHE_SIZE) {
+    if (indices.empty()) {
+        return 0.0f;
+    }
+    // A vertex is cached while fewer than cache_size misses happened since it was loaded
+    std::vector<size_t> loaded_at(vertex_count, SIZE_MAX);
+    size_t misses = 0;
+    for (auto v : indices) {
+        if (loaded_at[v] == SIZE_MAX || misses - loaded_at[v] >= cache_size) {
+            loaded_at[v] = misses;
+            misses++;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+float forsyth_vertex_score(int cache_position, uint32_t remaining_triangles) {
+    if (remaining_triangles == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            // The triangle that was just drawn gets a fixed score so it isn't picked again at once
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        } else {
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cache_position - 3) * scale, FORSYTH_CACHE_DECAY);
+        }
+    }
+    // Vertices with few triangles left are worth finishing off
+    score += FORSYTH_VALENCE_SCALE * powf((float)remaining_triangles, -FORSYTH_VALENCE_POWER);
+    return score;
+}
+
+// Reorders the triangles of an indexed triangle list to reuse the post-transform vertex cache, with
+// Tom Forsyth's linear-speed vertex cache optimisation
+void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles that still have to be emitted, per vertex
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (auto v : indices) {
+        offsets[v + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    std::vector<uint32_t> vertex_triangles(indices.size());
+    for (size_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[3 * t + k];
+            vertex_triangles[offsets[v] + remaining[v]++] = t;
+        }
+    }
+
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+    }
+    std::vector<float> triangle_score(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] +
+                            vertex_score[indices[3 * t + 2]];
+    }
+    std::vector<bool> emitted(triangle_count, false);
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> next_cache;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    size_t scan = 0;
+    int64_t best = -1;
+
+    for (size_t n = 0; n < triangle_count; n++) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left so continue with the next one in input order
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = scan;
+        }
+
+        uint32_t triangle = best;
+        emitted[triangle] = true;
+        const uint32_t* corners = &indices[3 * triangle];
+        output.insert(output.end(), corners, corners + 3);
+
+        // Take the triangle off its vertices' lists
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = corners[k];
+            uint32_t* list = &vertex_triangles[offsets[v]];
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                if (list[i] == triangle) {
+                    list[i] = list[--remaining[v]];
+                    break;
+                }
+            }
+        }
+
+        // Move its vertices to the front of the cache
+        next_cache.assign(corners, corners + 3);
+        for (auto v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                next_cache.push_back(v);
+            }
+        }
+        cache.swap(next_cache);
+
+        // Rescore everything in the cache (and what just fell out of it) and the triangles
+        // around it
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t v = cache[i];
+            int position = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            float score = forsyth_vertex_score(position, remaining[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                triangle_score[vertex_triangles[offsets[v] + j]] += delta;
+            }
+        }
+        if (cache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+            cache.resize(FORSYTH_CACHE_SIZE);
+        }
+
+        best = -1;
+        float best_score = -INFINITY;
+        for (auto v : cache) {
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                uint32_t t = vertex_triangles[offsets[v] + j];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+// Renumbers vertices in the order the index list first uses them, so consecutive triangles use
+// nearby vertices. Fills remap with the new index of every old vertex and rewrites indices.
+void reorder_vertices_by_first_use(std::vector<uint32_t>& indices, size_t vertex_count,
+                                   std::vector<uint32_t>& remap) {
+    remap.assign(vertex_count, UINT32_MAX);
+    uint32_t next = 0;
+    for (auto& v : indices) {
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+    // Vertices no triangle uses keep their relative order at the end
+    for (auto& r : remap) {
+        if (r == UINT32_MAX) {
+            r = next++;
+        }
+    }
+}
+
+#endif
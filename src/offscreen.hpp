@@ -0,0 +1,229 @@
+#include "../include/glm/glm.hpp"
+#include "../include/glm/gtc/matrix_transform.hpp"
+#include "constants.hpp"
+#include "software_rasterizer.hpp"
+#include "vertex_data.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <math.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef offscreen_hpp
+#define offscreen_hpp
+
+// Frames that can wait for the encoder before rendering stalls, which bounds the memory in flight
+const size_t FRAME_QUEUE_DEPTH = 4;
+
+// Projection shared by the window and the offscreen renders
+glm::mat4 scene_projection(float fov, float aspect) {
+    return glm::perspective(glm::radians(fov), aspect, CAMERA_NEAR, CAMERA_FAR);
+}
+
+// Camera path of the offscreen renders: one turn around the Y axis at the given distance from the
+// origin, looking at it
+glm::mat4 orbit_view(size_t frame, size_t frame_count, float radius) {
+    float angle = 2.0f * (float)M_PI * frame / std::max<size_t>(frame_count, 1);
+    glm::vec3 eye(radius * sinf(angle), 0.0f, radius * cosf(angle));
+    return glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// Where frame n of an export goes: prefix_0000.ppm, prefix_0001.ppm and so on
+std::string frame_path(const std::string& prefix, size_t frame) {
+    char number[32];
+    snprintf(number, sizeof(number), "_%04zu.ppm", frame);
+    return prefix + number;
+}
+
+// Writes RGBA8 pixels as a binary PPM, dropping alpha. OpenGL reads rows back from the bottom, so
+// bottom_up flips them on the way out. Returns false if the file can't be written.
+bool write_ppm(const std::string& path, int width, int height, const uint8_t* rgba,
+               bool bottom_up) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<uint8_t> row((size_t)width * 3);
+    bool ok = true;
+    for (int y = 0; y < height && ok; y++) {
+        const uint8_t* in = rgba + (size_t)(bottom_up ? height - 1 - y : y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[3 * x] = in[4 * x];
+            row[3 * x + 1] = in[4 * x + 1];
+            row[3 * x + 2] = in[4 * x + 2];
+        }
+        ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// A rendered frame on its way to disk
+struct ExportFrame {
+    int width;
+    int height;
+    bool bottom_up;
+    std::string path;
+    std::vector<uint8_t> rgba;
+
+    ExportFrame() : width(0), height(0), bottom_up(false), path(), rgba() {}
+};
+
+// Writes frames on a background thread so encoding overlaps with rendering the next ones. Pixel
+// buffers are swapped in and out instead of copied and recycled once written.
+class FrameEncoder {
+  public:
+    explicit FrameEncoder(size_t queue_depth = FRAME_QUEUE_DEPTH)
+        : queue_depth(std::max<size_t>(queue_depth, 1)), frames_written(0), bytes_written(0),
+          failures(0), wait_seconds(0.0), mutex(), changed(), queue(), spare(), stopping(false),
+          thread(&FrameEncoder::run, this) {}
+
+    ~FrameEncoder() {
+        finish();
+    }
+
+    // Queues a frame, leaving a recycled buffer in its place. Blocks while queue_depth frames are
+    // already waiting.
+    void submit(ExportFrame& frame) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return queue.size() < queue_depth; });
+        wait_seconds +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        queue.push_back(ExportFrame());
+        std::swap(queue.back(), frame);
+        if (!spare.empty()) {
+            frame.rgba.swap(spare.back());
+            spare.pop_back();
+        }
+        changed.notify_all();
+    }
+
+    // Waits for every queued frame to be written and stops the thread
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return;
+            }
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    // Only safe to read after finish()
+    size_t written() const {
+        return frames_written;
+    }
+
+    size_t bytes() const {
+        return bytes_written;
+    }
+
+    size_t failed() const {
+        return failures;
+    }
+
+    // Time submit() spent blocked on a full queue, which is where encoding failed to keep up
+    double blocked_seconds() const {
+        return wait_seconds;
+    }
+
+  private:
+    size_t queue_depth;
+    size_t frames_written;
+    size_t bytes_written;
+    size_t failures;
+    double wait_seconds;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<ExportFrame> queue;
+    std::vector<std::vector<uint8_t> > spare;
+    bool stopping;
+    std::thread thread;
+
+    FrameEncoder(const FrameEncoder&);
+    FrameEncoder& operator=(const FrameEncoder&);
+
+    void run() {
+        ExportFrame frame;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                std::swap(frame, queue.front());
+                queue.pop_front();
+            }
+            // The queue has room again as soon as the frame is taken off it
+            changed.notify_all();
+
+            bool ok = write_ppm(frame.path, frame.width, frame.height, frame.rgba.data(),
+                                frame.bottom_up);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ok) {
+                    frames_written++;
+                    bytes_written += (size_t)frame.width * frame.height * 3;
+                } else {
+                    failures++;
+                }
+                spare.push_back(std::vector<uint8_t>());
+                spare.back().swap(frame.rgba);
+            }
+        }
+    }
+};
+
+// What a headless run renders and where it goes
+struct OffscreenSettings {
+    int width;
+    int height;
+    size_t frame_count;
+    float fov;
+    float orbit_radius;
+    std::string output; // file prefix, see frame_path()
+    size_t thread_count;
+};
+
+// Renders the frames of an offscreen run with the CPU rasterizer and queues them on the encoder.
+// Returns the seconds spent rendering, not counting time blocked on the encoder.
+double render_offscreen_software(const MeshData& mesh, const OffscreenSettings& settings,
+                                 FrameEncoder& encoder) {
+    Framebuffer framebuffer;
+    resize_framebuffer(framebuffer, settings.width, settings.height);
+    SoftwareRasterizer rasterizer;
+    glm::mat4 projection =
+        scene_projection(settings.fov, (float)settings.width / settings.height);
+    ExportFrame frame;
+    double render_seconds = 0.0;
+    for (size_t n = 0; n < settings.frame_count; n++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        clear_framebuffer(framebuffer, glm::vec3(CLEAR_COLOR));
+        glm::mat4 view = orbit_view(n, settings.frame_count, settings.orbit_radius);
+        rasterizer.draw(mesh, projection * view * mesh.layout.dequantize, framebuffer,
+                        settings.thread_count);
+        render_seconds +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // The framebuffer is drawn into again next frame, so the encoder gets a copy
+        frame.width = settings.width;
+        frame.height = settings.height;
+        frame.bottom_up = false;
+        frame.path = frame_path(settings.output, n);
+        frame.rgba.assign(framebuffer.color.begin(), framebuffer.color.end());
+        encoder.submit(frame);
+    }
+    return render_seconds;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include "../include/glm/glm.hpp"
+
+#include <math.h>
+
+#ifndef predicates_hpp
+#define predicates_hpp
+
+// Exact geometric predicates after Jonathan Shewchuk's "Adaptive Precision Floating-Point
+// Arithmetic and Fast Robust Geometric Predicates". A double precision evaluation is trusted when
+// it is further from zero than its worst case rounding error and the sign is otherwise computed
+// exactly with floating-point expansions: sums of non-overlapping doubles ordered by magnitude.
+
+const double PREDICATE_EPSILON = 1.1102230246251565e-16; // 2^-53
+const double PREDICATE_SPLITTER = 134217729.0;           // 2^27 + 1
+const double ORIENT3D_ERROR_BOUND = (7.0 + 56.0 * PREDICATE_EPSILON) * PREDICATE_EPSILON;
+
+// Largest expansion orient3d_exact() can build: 2 term differences, multiplied twice and summed
+const int ORIENT3D_MAX_TERMS = 192;
+
+// a + b == x + y exactly, with x the rounded sum
+void two_sum(double a, double b, double& x, double& y) {
+    x = a + b;
+    double b_virtual = x - a;
+    double a_virtual = x - b_virtual;
+    y = (a - a_virtual) + (b - b_virtual);
+}
+
+void two_diff(double a, double b, double& x, double& y) {
+    x = a - b;
+    double b_virtual = a - x;
+    double a_virtual = x + b_virtual;
+    y = (a - a_virtual) + (b_virtual - b);
+}
+
+// Splits a into two halves of 26 bits so their products are exact
+void split(double a, double& hi, double& lo) {
+    double c = PREDICATE_SPLITTER * a;
+    double big = c - a;
+    hi = c - big;
+    lo = a - hi;
+}
+
+// a * b == x + y exactly, with x the rounded product
+void two_product(double a, double b, double& x, double& y) {
+    x = a * b;
+    double a_hi, a_lo, b_hi, b_lo;
+    split(a, a_hi, a_lo);
+    split(b, b_hi, b_lo);
+    double err1 = x - a_hi * b_hi;
+    double err2 = err1 - a_lo * b_hi;
+    double err3 = err2 - a_hi * b_lo;
+    y = a_lo * b_lo - err3;
+}
+
+// h = e + b, dropping zero terms. Returns the length of h, which can be e itself.
+int grow_expansion(int e_length, const double* e, double b, double* h) {
+    double q = b;
+    int h_length = 0;
+    for (int i = 0; i < e_length; i++) {
+        double sum, error;
+        two_sum(q, e[i], sum, error);
+        q = sum;
+        if (error != 0.0) {
+            h[h_length++] = error;
+        }
+    }
+    if (q != 0.0 || h_length == 0) {
+        h[h_length++] = q;
+    }
+    return h_length;
+}
+
+// h = e + f, dropping zero terms. h has to have room for e_length + f_length terms and must not
+// be f.
+int expansion_sum(int e_length, const double* e, int f_length, const double* f, double* h) {
+    int h_length = e_length;
+    for (int i = 0; i < e_length; i++) {
+        h[i] = e[i];
+    }
+    for (int i = 0; i < f_length; i++) {
+        h_length = grow_expansion(h_length, h, f[i], h);
+    }
+    return h_length;
+}
+
+// h = e * b, dropping zero terms. h has room for 2 * e_length terms and must not be e.
+int scale_expansion(int e_length, const double* e, double b, double* h) {
+    int h_length = 0;
+    double q, error;
+    two_product(e[0], b, q, error);
+    if (error != 0.0) {
+        h[h_length++] = error;
+    }
+    for (int i = 1; i < e_length; i++) {
+        double product, product_error, sum;
+        two_product(e[i], b, product, product_error);
+        two_sum(q, product_error, sum, error);
+        if (error != 0.0) {
+            h[h_length++] = error;
+        }
+        two_sum(product, sum, q, error);
+        if (error != 0.0) {
+            h[h_length++] = error;
+        }
+    }
+    if (q != 0.0 || h_length == 0) {
+        h[h_length++] = q;
+    }
+    return h_length;
+}
+
+// h = e * f. h has room for 2 * e_length * f_length terms.
+int expansion_product(int e_length, const double* e, int f_length, const double* f, double* h) {
+    double scaled[2 * ORIENT3D_MAX_TERMS];
+    double sum[ORIENT3D_MAX_TERMS];
+    int h_length = 1;
+    h[0] = 0.0;
+    for (int i = 0; i < f_length; i++) {
+        int scaled_length = scale_expansion(e_length, e, f[i], scaled);
+        int sum_length = expansion_sum(h_length, h, scaled_length, scaled, sum);
+        for (int j = 0; j < sum_length; j++) {
+            h[j] = sum[j];
+        }
+        h_length = sum_length;
+    }
+    return h_length;
+}
+
+// The largest term of an expansion carries its sign
+int expansion_sign(int e_length, const double* e) {
+    double top = e[e_length - 1];
+    return (top > 0.0) - (top < 0.0);
+}
+
+// Exact sign of one of the three terms of orient3d_exact(): z * (x1 * y1 - x2 * y2) with all
+// factors two term expansions. h has room for 64 terms.
+int orient3d_term(const double* z, const double* x1, const double* y1, const double* x2,
+                  const double* y2, double* h) {
+    double first[8], second[8], difference[16];
+    int first_length = expansion_product(2, x1, 2, y1, first);
+    int second_length = expansion_product(2, x2, 2, y2, second);
+    for (int i = 0; i < second_length; i++) {
+        second[i] = -second[i];
+    }
+    int difference_length =
+        expansion_sum(first_length, first, second_length, second, difference);
+    return expansion_product(difference_length, difference, 2, z, h);
+}
+
+int orient3d_exact(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+                   const glm::vec3& d) {
+    double adx[2], ady[2], adz[2], bdx[2], bdy[2], bdz[2], cdx[2], cdy[2], cdz[2];
+    two_diff(a.x, d.x, adx[1], adx[0]);
+    two_diff(a.y, d.y, ady[1], ady[0]);
+    two_diff(a.z, d.z, adz[1], adz[0]);
+    two_diff(b.x, d.x, bdx[1], bdx[0]);
+    two_diff(b.y, d.y, bdy[1], bdy[0]);
+    two_diff(b.z, d.z, bdz[1], bdz[0]);
+    two_diff(c.x, d.x, cdx[1], cdx[0]);
+    two_diff(c.y, d.y, cdy[1], cdy[0]);
+    two_diff(c.z, d.z, cdz[1], cdz[0]);
+
+    double a_term[64], b_term[64], c_term[64], ab[128], det[ORIENT3D_MAX_TERMS];
+    int a_length = orient3d_term(adz, bdx, cdy, cdx, bdy, a_term);
+    int b_length = orient3d_term(bdz, cdx, ady, adx, cdy, b_term);
+    int c_length = orient3d_term(cdz, adx, bdy, bdx, ady, c_term);
+    int ab_length = expansion_sum(a_length, a_term, b_length, b_term, ab);
+    int det_length = expansion_sum(ab_length, ab, c_length, c_term, det);
+    return expansion_sign(det_length, det);
+}
+
+// Sign of the volume of the tetrahedron abcd: positive when d is below the plane of a, b and c
+// (they appear counter-clockwise from above), negative above it and 0 when all four are coplanar.
+// Exact for any float input.
+int orient3d(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d) {
+    double adx = (double)a.x - d.x, ady = (double)a.y - d.y, adz = (double)a.z - d.z;
+    double bdx = (double)b.x - d.x, bdy = (double)b.y - d.y, bdz = (double)b.z - d.z;
+    double cdx = (double)c.x - d.x, cdy = (double)c.y - d.y, cdz = (double)c.z - d.z;
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    double cdxady = cdx * ady, adxcdy = adx * cdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady;
+    double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+    double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * fabs(adz) +
+                       (fabs(cdxady) + fabs(adxcdy)) * fabs(bdz) +
+                       (fabs(adxbdy) + fabs(bdxady)) * fabs(cdz);
+    double bound = ORIENT3D_ERROR_BOUND * permanent;
+    if (det > bound) {
+        return 1;
+    }
+    if (-det > bound) {
+        return -1;
+    }
+    return orient3d_exact(a, b, c, d);
+}
+
+// Exact segment/triangle test from orientation signs alone. The segment has to reach the plane of
+// the triangle from both sides (or touch it) and the line through it has to pass inside or on all
+// three edges. Segments lying in the plane of the triangle, and degenerate triangles, never hit.
+bool intersects_segment_exact(const glm::vec3& p, const glm::vec3& q, const glm::vec3& a,
+                              const glm::vec3& b, const glm::vec3& c) {
+    int side_p = orient3d(a, b, c, p);
+    int side_q = orient3d(a, b, c, q);
+    if (side_p == side_q) {
+        // Both on one side, or both in the plane
+        return false;
+    }
+    int ab = orient3d(p, q, a, b);
+    int bc = orient3d(p, q, b, c);
+    int ca = orient3d(p, q, c, a);
+    return (ab >= 0 && bc >= 0 && ca >= 0) || (ab <= 0 && bc <= 0 && ca <= 0);
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "../include/glm/glm.hpp"
+#include "constants.hpp"
+#include "geometry.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#ifndef scene_hpp
+#define scene_hpp
+
+void create_geometry(TriangleStore& triangles, LineStore& lines) {
+    triangles.push_back((Triangle){.a_pos = {0.0f, 0.0f, -1.0f},
+                                   .b_pos = {1.0f, 0.0f, -1.0f},
+                                   .c_pos = {0.0f, 1.0f, -1.0f},
+                                   .a_col = YELLOW_COLOR,
+                                   .b_col = YELLOW_COLOR,
+                                   .c_col = YELLOW_COLOR});
+    triangles.push_back((Triangle){.a_pos = {0.0f, 0.0f, -2.0f},
+                                   .b_pos = {1.0f, 0.0f, -2.0f},
+                                   .c_pos = {0.0f, 1.0f, -2.0f},
+                                   .a_col = YELLOW_COLOR,
+                                   .b_col = YELLOW_COLOR,
+                                   .c_col = YELLOW_COLOR});
+    lines.push_back((Line){.a_pos = {0.4f, 0.4f, 0.0f},
+                           .b_pos = {0.4f, 0.4f, -1.5f},
+                           .a_col = GREEN_COLOR,
+                           .b_col = GREEN_COLOR});
+    lines.push_back((Line){.a_pos = {0.0f, 2.0f, -3.0f},
+                           .b_pos = {2.0f, 0.0f, -1.0f},
+                           .a_col = GREEN_COLOR,
+                           .b_col = GREEN_COLOR});
+}
+
+// Small xorshift generator so synthetic scenes come out the same with every standard library
+float random_float(uint32_t& state, float lo, float hi) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return lo + (hi - lo) * ((state >> 8) * (1.0f / 16777216.0f));
+}
+
+glm::vec3 random_vec3(uint32_t& state, float lo, float hi) {
+    float x = random_float(state, lo, hi);
+    float y = random_float(state, lo, hi);
+    float z = random_float(state, lo, hi);
+    return glm::vec3(x, y, z);
+}
+
+// Scatters unit sized triangles and short lines through a cube that grows with the triangle count
+// so the density, and with it the hits per line, stays about the same at every size
+void create_random_geometry(TriangleStore& triangles, LineStore& lines, size_t triangle_count,
+                            size_t line_count, uint32_t seed) {
+    uint32_t state = seed ? seed : 1;
+    float extent = cbrtf((float)triangle_count) * 0.5f + 1.0f;
+
+    triangles.reserve(triangles.size() + triangle_count);
+    for (size_t i = 0; i < triangle_count; i++) {
+        glm::vec3 center = random_vec3(state, -extent, extent);
+        Triangle triangle;
+        triangle.a_pos = center + random_vec3(state, -0.5f, 0.5f);
+        triangle.b_pos = center + random_vec3(state, -0.5f, 0.5f);
+        triangle.c_pos = center + random_vec3(state, -0.5f, 0.5f);
+        triangle.a_col = YELLOW_COLOR;
+        triangle.b_col = YELLOW_COLOR;
+        triangle.c_col = YELLOW_COLOR;
+        triangles.push_back(triangle);
+    }
+
+    lines.reserve(lines.size() + line_count);
+    for (size_t i = 0; i < line_count; i++) {
+        Line line;
+        line.a_pos = random_vec3(state, -extent, extent);
+        line.b_pos = line.a_pos + random_vec3(state, -2.0f, 2.0f);
+        line.a_col = GREEN_COLOR;
+        line.b_col = GREEN_COLOR;
+        lines.push_back(line);
+    }
+}
+
+// Like create_random_geometry(), but every triangle and line is a copy of one of shape_count
+// random shapes moved somewhere in the cube, the kind of scene instancing pays off on
+void create_repeated_geometry(TriangleStore& triangles, LineStore& lines, size_t triangle_count,
+                              size_t line_count, size_t shape_count, uint32_t seed) {
+    uint32_t state = seed ? seed : 1;
+    float extent = cbrtf((float)triangle_count) * 0.5f + 1.0f;
+    shape_count = std::max<size_t>(shape_count, 1);
+    std::vector<Triangle> triangle_shapes(shape_count);
+    std::vector<Line> line_shapes(shape_count);
+    for (size_t s = 0; s < shape_count; s++) {
+        Triangle& triangle = triangle_shapes[s];
+        triangle.a_pos = random_vec3(state, -0.5f, 0.5f);
+        triangle.b_pos = random_vec3(state, -0.5f, 0.5f);
+        triangle.c_pos = random_vec3(state, -0.5f, 0.5f);
+        triangle.a_col = YELLOW_COLOR;
+        triangle.b_col = YELLOW_COLOR;
+        triangle.c_col = YELLOW_COLOR;
+        Line& line = line_shapes[s];
+        line.a_pos = glm::vec3(0.0f);
+        line.b_pos = random_vec3(state, -2.0f, 2.0f);
+        line.a_col = GREEN_COLOR;
+        line.b_col = GREEN_COLOR;
+    }
+
+    triangles.reserve(triangles.size() + triangle_count);
+    for (size_t i = 0; i < triangle_count; i++) {
+        glm::vec3 center = random_vec3(state, -extent, extent);
+        Triangle triangle = triangle_shapes[i % shape_count];
+        triangle.a_pos += center;
+        triangle.b_pos += center;
+        triangle.c_pos += center;
+        triangles.push_back(triangle);
+    }
+
+    lines.reserve(lines.size() + line_count);
+    for (size_t i = 0; i < line_count; i++) {
+        glm::vec3 start = random_vec3(state, -extent, extent);
+        Line line = line_shapes[i % shape_count];
+        line.a_pos += start;
+        line.b_pos += start;
+        lines.push_back(line);
+    }
+}
+
+// Lines sway up and down by this much around where they started, a little out of step with each
+// other
+const float ANIMATION_AMPLITUDE = 0.5f;
+const float ANIMATION_SPEED = 1.5f; // radians per second
+const float ANIMATION_PHASE_STEP = 0.7f;
+
+// Moves every line to its rest position offset along Y for the given time in seconds
+void animate_lines(const LineStore& rest, float time, LineStore& lines) {
+    for (size_t i = 0; i < lines.size(); i++) {
+        float phase = ANIMATION_SPEED * time + ANIMATION_PHASE_STEP * i;
+        glm::vec3 offset(0.0f, ANIMATION_AMPLITUDE * sinf(phase), 0.0f);
+        lines.a_pos[i] = rest.a_pos[i] + offset;
+        lines.b_pos[i] = rest.b_pos[i] + offset;
+    }
+}
+
+#endif
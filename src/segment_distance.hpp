@@ -0,0 +1,63 @@
+#include "../include/glm/glm.hpp"
+
+#ifndef segment_distance_hpp
+#define segment_distance_hpp
+
+// Closest points between the segments p1 to q1 and p2 to q2, after Christer Ericson's "Real-Time
+// Collision Detection" (5.1.9). c1 = p1 + s * (q1 - p1) and c2 = p2 + t * (q2 - p2) with s and t
+// in [0, 1]. Returns the squared distance between c1 and c2. Segments of zero length are points,
+// and parallel segments get one of their closest pairs.
+float closest_points_segments(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2,
+                              const glm::vec3& q2, float& s, float& t, glm::vec3& c1,
+                              glm::vec3& c2) {
+    glm::vec3 d1 = q1 - p1;
+    glm::vec3 d2 = q2 - p2;
+    glm::vec3 r = p1 - p2;
+    float a = glm::dot(d1, d1);
+    float e = glm::dot(d2, d2);
+    float f = glm::dot(d2, r);
+
+    if (a == 0.0f && e == 0.0f) {
+        s = 0.0f;
+        t = 0.0f;
+    } else if (a == 0.0f) {
+        // First segment is a point
+        s = 0.0f;
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    } else {
+        float c = glm::dot(d1, r);
+        if (e == 0.0f) {
+            // Second segment is a point
+            t = 0.0f;
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else {
+            float b = glm::dot(d1, d2);
+            float denom = a * e - b * b; // always >= 0, and 0 when parallel
+            s = denom != 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+            // Closest point on the second line to the one picked on the first, and if that falls
+            // outside the second segment, clamp it and pick again on the first
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+
+    c1 = p1 + d1 * s;
+    c2 = p2 + d2 * t;
+    glm::vec3 gap = c1 - c2;
+    return glm::dot(gap, gap);
+}
+
+float segment_distance_squared(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2,
+                               const glm::vec3& q2) {
+    float s, t;
+    glm::vec3 c1, c2;
+    return closest_points_segments(p1, q1, p2, q2, s, t, c1, c2);
+}
+
+#endif
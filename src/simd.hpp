@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <new>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef simd_hpp
+#define simd_hpp
+
+// Instruction sets the batched kernels can run with
+enum class SimdLevel {
+    SCALAR, // One lane at a time, works everywhere
+    SSE,    // 4 lanes
+    AVX2    // 8 lanes
+};
+
+const size_t SIMD_MAX_WIDTH = 8;
+const size_t SIMD_ALIGNMENT = 32;
+
+SimdLevel detect_simd_level() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::SSE;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+// Picked once at startup, can be lowered to compare against the scalar path
+SimdLevel simd_level = detect_simd_level();
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::SSE:
+        return "sse";
+    default:
+        return "scalar";
+    }
+}
+
+// Allocator for std::vector storage that the kernels can load from with aligned instructions
+template <typename T, size_t Alignment = SIMD_ALIGNMENT> struct AlignedAllocator {
+    typedef T value_type;
+
+    template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        void* p = NULL;
+        if (posix_memalign(&p, Alignment, n * sizeof(T) > 0 ? n * sizeof(T) : Alignment) != 0) {
+            throw std::bad_alloc();
+        }
+        return (T*)p;
+    }
+
+    void deallocate(T* p, size_t) {
+        free(p);
+    }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+    return true;
+}
+
+template <typename T, typename U, size_t A>
+bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) {
+    return false;
+}
+
+typedef std::vector<float, AlignedAllocator<float> > FloatArray;
+
+#endif
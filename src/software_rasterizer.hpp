@@ -0,0 +1,428 @@
+#include "../include/glm/glm.hpp"
+#include "thread_pool.hpp"
+#include "vertex_data.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#ifndef software_rasterizer_hpp
+#define software_rasterizer_hpp
+
+// Side of the square screen tiles primitives are binned into. Every tile is drawn by one thread,
+// so tiles never share pixels.
+const int RASTER_TILE_SIZE = 64;
+
+// Window coordinates are snapped to 1/256 of a pixel so edge functions are exact integers and
+// triangles that share an edge never both or neither cover a pixel on it
+const int RASTER_SUBPIXEL_BITS = 8;
+const int64_t RASTER_SUBPIXEL_SCALE = (int64_t)1 << RASTER_SUBPIXEL_BITS;
+
+const size_t RASTER_VERTICES_PER_CHUNK = 4096;
+const size_t RASTER_PRIMITIVES_PER_CHUNK = 1024;
+
+// Enough room for a triangle clipped by all six frustum planes
+const int RASTER_MAX_CLIPPED_VERTICES = 9;
+
+// RGBA8 color and depth in [0, 1] for every pixel, rows from the top
+struct Framebuffer {
+    int width;
+    int height;
+    std::vector<uint8_t> color;
+    std::vector<float> depth;
+};
+
+void resize_framebuffer(Framebuffer& framebuffer, int width, int height) {
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.color.resize((size_t)width * height * 4);
+    framebuffer.depth.resize((size_t)width * height);
+}
+
+// Like glClear() of the color and depth buffers, with the depth cleared to the far plane
+void clear_framebuffer(Framebuffer& framebuffer, const glm::vec3& color) {
+    uint8_t rgba[4] = {glm::packUnorm1x8(color.r), glm::packUnorm1x8(color.g),
+                       glm::packUnorm1x8(color.b), 255};
+    for (size_t i = 0; i < framebuffer.depth.size(); i++) {
+        memcpy(&framebuffer.color[4 * i], rgba, 4);
+    }
+    std::fill(framebuffer.depth.begin(), framebuffer.depth.end(), 1.0f);
+}
+
+// Output of the vertex stage, what vert.glsl hands to the rasterizer
+struct RasterVertex {
+    glm::vec4 clip;
+    glm::vec3 color;
+};
+
+// A primitive after clipping and the perspective divide. window is x and y in pixels from the top
+// left and z the depth in [0, 1]. Colors are kept divided by w so they can be interpolated with
+// perspective like OpenGL does.
+struct RasterPrimitive {
+    PrimitiveType primitive;
+    glm::vec3 window[3];
+    float inv_w[3];
+    glm::vec3 color_w[3];
+    int min_x, min_y, max_x, max_y; // pixels it can touch, inclusive
+};
+
+// What the last draw() did
+struct RasterStats {
+    size_t primitives_in;  // triangles and lines in the mesh
+    size_t primitives_out; // after clipping, which can split a triangle or drop it altogether
+    size_t tile_count;
+    size_t binned; // primitive references across all tiles
+};
+
+// Distance of a clip space vertex to each frustum plane, positive inside
+float clip_distance(const glm::vec4& v, int plane) {
+    switch (plane) {
+    case 0:
+        return v.w + v.x;
+    case 1:
+        return v.w - v.x;
+    case 2:
+        return v.w + v.y;
+    case 3:
+        return v.w - v.y;
+    case 4:
+        return v.w + v.z;
+    default:
+        return v.w - v.z;
+    }
+}
+
+RasterVertex lerp_vertex(const RasterVertex& a, const RasterVertex& b, float t) {
+    return (RasterVertex){.clip = a.clip + (b.clip - a.clip) * t,
+                          .color = a.color + (b.color - a.color) * t};
+}
+
+// Sutherland-Hodgman clipping of a polygon against the six frustum planes, in place. Returns the
+// new vertex count, below 3 when nothing is left.
+int clip_polygon(RasterVertex* polygon, int count) {
+    RasterVertex clipped[RASTER_MAX_CLIPPED_VERTICES];
+    for (int plane = 0; plane < 6 && count >= 3; plane++) {
+        bool inside = true;
+        for (int i = 0; i < count && inside; i++) {
+            inside = clip_distance(polygon[i].clip, plane) >= 0.0f;
+        }
+        if (inside) {
+            continue;
+        }
+        int clipped_count = 0;
+        for (int i = 0; i < count; i++) {
+            const RasterVertex& a = polygon[i];
+            const RasterVertex& b = polygon[(i + 1) % count];
+            float da = clip_distance(a.clip, plane);
+            float db = clip_distance(b.clip, plane);
+            if (da >= 0.0f) {
+                clipped[clipped_count++] = a;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                clipped[clipped_count++] = lerp_vertex(a, b, da / (da - db));
+            }
+        }
+        std::copy(clipped, clipped + clipped_count, polygon);
+        count = clipped_count;
+    }
+    return count;
+}
+
+// Clips a line against the six frustum planes, in place. Returns false when nothing is left.
+bool clip_line(RasterVertex& a, RasterVertex& b) {
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    for (int plane = 0; plane < 6; plane++) {
+        float da = clip_distance(a.clip, plane);
+        float db = clip_distance(b.clip, plane);
+        if (da < 0.0f && db < 0.0f) {
+            return false;
+        }
+        if (da < 0.0f) {
+            t0 = std::max(t0, da / (da - db));
+        } else if (db < 0.0f) {
+            t1 = std::min(t1, da / (da - db));
+        }
+    }
+    if (t0 > t1) {
+        return false;
+    }
+    RasterVertex start = lerp_vertex(a, b, t0);
+    b = lerp_vertex(a, b, t1);
+    a = start;
+    return true;
+}
+
+// Rasterizes indexed triangles and lines from packed vertex data on the CPU, like draw() in
+// main.cpp does through OpenGL with vert.glsl and frag.glsl and the depth test set to GL_LESS.
+// Vertices are transformed in parallel, primitives are clipped and set up in parallel, binned
+// into tiles in the order they were submitted and then every tile is drawn by one thread. Scratch
+// space is kept between frames.
+class SoftwareRasterizer {
+  public:
+    RasterStats stats;
+
+    SoftwareRasterizer() : stats(), vertices(), primitives(), batch_starts(), bins() {}
+
+    // transform is projection * view * model, with the mesh's dequantize folded into the model
+    void draw(const MeshData& mesh, const glm::mat4& transform, Framebuffer& framebuffer,
+              size_t thread_count) {
+        ThreadPool& pool = shared_thread_pool(thread_count);
+        shade_vertices(pool, mesh, transform);
+        setup_primitives(pool, mesh, framebuffer);
+        bin_primitives(framebuffer);
+
+        int tiles_x = (framebuffer.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        pool.parallel_for(bins.size(), [&](size_t tile, size_t) {
+            int x0 = (tile % tiles_x) * RASTER_TILE_SIZE;
+            int y0 = (tile / tiles_x) * RASTER_TILE_SIZE;
+            int x1 = std::min(x0 + RASTER_TILE_SIZE, framebuffer.width);
+            int y1 = std::min(y0 + RASTER_TILE_SIZE, framebuffer.height);
+            for (auto i : bins[tile]) {
+                const RasterPrimitive& primitive = primitives[i];
+                if (primitive.primitive == PrimitiveType::TRIANGLES) {
+                    draw_triangle(primitive, x0, y0, x1, y1, framebuffer);
+                } else {
+                    draw_line(primitive, x0, y0, x1, y1, framebuffer);
+                }
+            }
+        });
+    }
+
+  private:
+    std::vector<RasterVertex> vertices;
+    std::vector<RasterPrimitive> primitives;
+    std::vector<size_t> batch_starts; // first primitive of every batch, and the total at the end
+    std::vector<std::vector<uint32_t> > bins;
+
+    SoftwareRasterizer(const SoftwareRasterizer&);
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&);
+
+    void shade_vertices(ThreadPool& pool, const MeshData& mesh, const glm::mat4& transform) {
+        vertices.resize(mesh.vertex_count);
+        size_t chunk_count =
+            (mesh.vertex_count + RASTER_VERTICES_PER_CHUNK - 1) / RASTER_VERTICES_PER_CHUNK;
+        pool.parallel_for(chunk_count, [&](size_t chunk, size_t) {
+            size_t end = std::min(mesh.vertex_count, (chunk + 1) * RASTER_VERTICES_PER_CHUNK);
+            for (size_t v = chunk * RASTER_VERTICES_PER_CHUNK; v < end; v++) {
+                vertices[v].clip = transform * glm::vec4(read_position(mesh, v), 1.0f);
+                vertices[v].color = read_color(mesh, v);
+            }
+        });
+    }
+
+    void setup_primitives(ThreadPool& pool, const MeshData& mesh, const Framebuffer& framebuffer) {
+        batch_starts.assign(1, 0);
+        for (const auto& batch : mesh.batches) {
+            size_t per_primitive =
+                batch.primitive == PrimitiveType::TRIANGLES ? TRI_VERTEX_COUNT : LINE_VERTEX_COUNT;
+            batch_starts.push_back(batch_starts.back() + batch.count / per_primitive);
+        }
+        stats.primitives_in = batch_starts.back();
+
+        parallel_collect(pool, stats.primitives_in, RASTER_PRIMITIVES_PER_CHUNK, primitives,
+                         [&](size_t n, size_t, std::vector<RasterPrimitive>& buffer) {
+            size_t b = std::upper_bound(batch_starts.begin(), batch_starts.end(), n) -
+                       batch_starts.begin() - 1;
+            const DrawBatch& batch = mesh.batches[b];
+            size_t k = n - batch_starts[b];
+            if (batch.primitive == PrimitiveType::TRIANGLES) {
+                RasterVertex polygon[RASTER_MAX_CLIPPED_VERTICES];
+                for (int c = 0; c < 3; c++) {
+                    polygon[c] = vertices[batch_vertex(mesh, batch, 3 * k + c)];
+                }
+                int count = clip_polygon(polygon, 3);
+                // Fan the clipped polygon back into triangles
+                for (int c = 1; c + 1 < count; c++) {
+                    RasterVertex corners[3] = {polygon[0], polygon[c], polygon[c + 1]};
+                    buffer.push_back(make_primitive(PrimitiveType::TRIANGLES, corners, 3,
+                                                    framebuffer));
+                }
+            } else {
+                RasterVertex ends[2] = {vertices[batch_vertex(mesh, batch, 2 * k)],
+                                        vertices[batch_vertex(mesh, batch, 2 * k + 1)]};
+                if (clip_line(ends[0], ends[1])) {
+                    buffer.push_back(make_primitive(PrimitiveType::LINES, ends, 2, framebuffer));
+                }
+            }
+        });
+        stats.primitives_out = primitives.size();
+    }
+
+    // Perspective divide and viewport transform of clipped vertices
+    static RasterPrimitive make_primitive(PrimitiveType type, const RasterVertex* corners,
+                                          int count, const Framebuffer& framebuffer) {
+        RasterPrimitive primitive;
+        primitive.primitive = type;
+        glm::vec2 lo(INFINITY), hi(-INFINITY);
+        for (int c = 0; c < 3; c++) {
+            const RasterVertex& v = corners[std::min(c, count - 1)];
+            float inv_w = 1.0f / v.clip.w;
+            glm::vec3 ndc = glm::vec3(v.clip) * inv_w;
+            primitive.window[c] = glm::vec3((ndc.x * 0.5f + 0.5f) * framebuffer.width,
+                                            (0.5f - ndc.y * 0.5f) * framebuffer.height,
+                                            ndc.z * 0.5f + 0.5f);
+            primitive.inv_w[c] = inv_w;
+            primitive.color_w[c] = v.color * inv_w;
+            lo = glm::min(lo, glm::vec2(primitive.window[c]));
+            hi = glm::max(hi, glm::vec2(primitive.window[c]));
+        }
+        primitive.min_x = std::max((int)floorf(lo.x), 0);
+        primitive.min_y = std::max((int)floorf(lo.y), 0);
+        primitive.max_x = std::min((int)floorf(hi.x), framebuffer.width - 1);
+        primitive.max_y = std::min((int)floorf(hi.y), framebuffer.height - 1);
+        return primitive;
+    }
+
+    // Appends every primitive to the tiles its bounds touch, keeping submission order per tile
+    void bin_primitives(const Framebuffer& framebuffer) {
+        int tiles_x = (framebuffer.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        int tiles_y = (framebuffer.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        bins.resize((size_t)tiles_x * tiles_y);
+        for (auto& bin : bins) {
+            bin.clear();
+        }
+        stats.tile_count = bins.size();
+        stats.binned = 0;
+        for (size_t i = 0; i < primitives.size(); i++) {
+            const RasterPrimitive& primitive = primitives[i];
+            if (primitive.min_x > primitive.max_x || primitive.min_y > primitive.max_y) {
+                continue;
+            }
+            for (int ty = primitive.min_y / RASTER_TILE_SIZE;
+                 ty <= primitive.max_y / RASTER_TILE_SIZE; ty++) {
+                for (int tx = primitive.min_x / RASTER_TILE_SIZE;
+                     tx <= primitive.max_x / RASTER_TILE_SIZE; tx++) {
+                    bins[(size_t)ty * tiles_x + tx].push_back(i);
+                    stats.binned++;
+                }
+            }
+        }
+    }
+
+    // Depth test and color write of one fragment. l are the barycentric weights in the window.
+    // Depth is tested before the color is interpolated since most fragments of a deep scene fail.
+    static void shade_fragment(const RasterPrimitive& p, int count, const float* l, int x, int y,
+                               Framebuffer& framebuffer) {
+        float z = 0.0f;
+        for (int c = 0; c < count; c++) {
+            z += l[c] * p.window[c].z;
+        }
+        size_t pixel = (size_t)y * framebuffer.width + x;
+        if (!(z < framebuffer.depth[pixel])) {
+            return;
+        }
+        framebuffer.depth[pixel] = z;
+
+        float inv_w = 0.0f;
+        glm::vec3 color_w(0.0f);
+        for (int c = 0; c < count; c++) {
+            inv_w += l[c] * p.inv_w[c];
+            color_w += l[c] * p.color_w[c];
+        }
+        glm::vec3 color = color_w / inv_w;
+        uint8_t* out = &framebuffer.color[4 * pixel];
+        out[0] = glm::packUnorm1x8(color.r);
+        out[1] = glm::packUnorm1x8(color.g);
+        out[2] = glm::packUnorm1x8(color.b);
+        out[3] = 255;
+    }
+
+    // Covers pixel centers inside the triangle, and on an edge only when it is a top or left edge
+    static void draw_triangle(const RasterPrimitive& p, int x0, int y0, int x1, int y1,
+                              Framebuffer& framebuffer) {
+        int64_t X[3], Y[3];
+        for (int c = 0; c < 3; c++) {
+            X[c] = (int64_t)floorf(p.window[c].x * RASTER_SUBPIXEL_SCALE + 0.5f);
+            Y[c] = (int64_t)floorf(p.window[c].y * RASTER_SUBPIXEL_SCALE + 0.5f);
+        }
+        int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+        if (area == 0) {
+            return;
+        }
+        // Either winding is drawn, so order the corners to make the area positive
+        int order[3] = {0, 1, 2};
+        if (area < 0) {
+            std::swap(order[1], order[2]);
+            area = -area;
+        }
+
+        // Edge k is the one opposite corner k, and its function is that corner's weight
+        int64_t step_x[3], step_y[3], row_start[3], bias[3];
+        int min_x = std::max(p.min_x, x0), max_x = std::min(p.max_x, x1 - 1);
+        int min_y = std::max(p.min_y, y0), max_y = std::min(p.max_y, y1 - 1);
+        if (min_x > max_x || min_y > max_y) {
+            return;
+        }
+        int64_t px = min_x * RASTER_SUBPIXEL_SCALE + RASTER_SUBPIXEL_SCALE / 2;
+        int64_t py = min_y * RASTER_SUBPIXEL_SCALE + RASTER_SUBPIXEL_SCALE / 2;
+        for (int k = 0; k < 3; k++) {
+            int a = order[(k + 1) % 3], b = order[(k + 2) % 3];
+            int64_t dx = X[b] - X[a], dy = Y[b] - Y[a];
+            step_x[k] = -dy * RASTER_SUBPIXEL_SCALE;
+            step_y[k] = dx * RASTER_SUBPIXEL_SCALE;
+            row_start[k] = dx * (py - Y[a]) - dy * (px - X[a]);
+            // With y down and a positive area, top edges run in +x and left edges in -y
+            bool top_left = (dy == 0 && dx > 0) || dy < 0;
+            bias[k] = top_left ? 0 : -1;
+        }
+
+        RasterPrimitive ordered = p;
+        for (int c = 0; c < 3; c++) {
+            ordered.window[c] = p.window[order[c]];
+            ordered.inv_w[c] = p.inv_w[order[c]];
+            ordered.color_w[c] = p.color_w[order[c]];
+        }
+        float inv_area = 1.0f / (float)area;
+        for (int y = min_y; y <= max_y; y++) {
+            int64_t e[3] = {row_start[0], row_start[1], row_start[2]};
+            for (int x = min_x; x <= max_x; x++) {
+                if (((e[0] + bias[0]) | (e[1] + bias[1]) | (e[2] + bias[2])) >= 0) {
+                    float l[3] = {e[0] * inv_area, e[1] * inv_area, e[2] * inv_area};
+                    shade_fragment(ordered, 3, l, x, y, framebuffer);
+                }
+                for (int k = 0; k < 3; k++) {
+                    e[k] += step_x[k];
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                row_start[k] += step_y[k];
+            }
+        }
+    }
+
+    // One pixel wide line stepping along its major axis, covering the pixel centers from its lower
+    // end on that axis up to but not including the higher one
+    static void draw_line(const RasterPrimitive& p, int x0, int y0, int x1, int y1,
+                          Framebuffer& framebuffer) {
+        glm::vec2 a(p.window[0]), b(p.window[1]);
+        glm::vec2 d = b - a;
+        int major = fabsf(d.x) >= fabsf(d.y) ? 0 : 1;
+        int minor = 1 - major;
+        if (d[major] == 0.0f) {
+            return;
+        }
+        int lo[2] = {x0, y0}, hi[2] = {x1, y1};
+        float start = std::min(a[major], b[major]);
+        float end = std::max(a[major], b[major]);
+        int first = std::max((int)ceilf(start - 0.5f), lo[major]);
+        int last = std::min((int)ceilf(end - 0.5f), hi[major]); // exclusive
+        for (int i = first; i < last; i++) {
+            float t = (i + 0.5f - a[major]) / d[major];
+            int j = (int)floorf(a[minor] + t * d[minor]);
+            if (j < lo[minor] || j >= hi[minor]) {
+                continue;
+            }
+            float l[2] = {1.0f - t, t};
+            int pixel[2];
+            pixel[major] = i;
+            pixel[minor] = j;
+            shade_fragment(p, 2, l, pixel[0], pixel[1], framebuffer);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "../include/glm/glm.hpp"
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+#ifndef spatial_hash_hpp
+#define spatial_hash_hpp
+
+// Cells are this many times the average primitive extent
+const float GRID_CELL_SCALE = 1.0f;
+
+// Boxes are grown by this fraction of a cell when they are binned so a segment that only grazes a
+// cell boundary still finds them from either side
+const float GRID_CELL_MARGIN = 1e-3f;
+
+// Buckets per primitive, rounded up to a power of two
+const size_t GRID_BUCKETS_PER_ITEM = 4;
+const size_t GRID_MIN_BUCKETS = 1024;
+
+// Keeps cell coordinates far from overflowing when they are hashed or stepped
+const float GRID_MAX_CELL = 1e9f;
+
+struct GridCell {
+    int32_t v[3];
+};
+
+// Average of the largest side of every box, which is what a cell should be about the size of
+float tune_cell_size(const std::vector<AABB>& boxes) {
+    double total = 0.0;
+    for (const auto& box : boxes) {
+        glm::vec3 e = box.max - box.min;
+        total += glm::max(e.x, glm::max(e.y, e.z));
+    }
+    float size = boxes.empty() ? 0.0f : GRID_CELL_SCALE * (float)(total / boxes.size());
+    return size > 0.0f && isfinite(size) ? size : 1.0f;
+}
+
+// Uniform grid stored as a spatial hash: a box is added to the bucket of every cell it overlaps
+// and nothing is allocated for empty space. Unlike the BVH it can be edited in place, so moving a
+// primitive only costs a remove and an insert. Distinct cells can share a bucket, so queries may
+// report an id more than once and callers have to filter duplicates.
+class SpatialHash {
+  public:
+    float cell_size;
+    std::vector<std::vector<uint32_t> > buckets;
+
+    SpatialHash() : cell_size(1.0f), buckets() {}
+
+    // Drops everything and sizes the table for about item_count primitives. Buckets keep their
+    // storage when the table stays the same size, so rebuilding every frame doesn't allocate.
+    void reset(float size, size_t item_count) {
+        cell_size = size;
+        size_t bucket_count = GRID_MIN_BUCKETS;
+        while (bucket_count < item_count * GRID_BUCKETS_PER_ITEM) {
+            bucket_count *= 2;
+        }
+        if (buckets.size() != bucket_count) {
+            buckets.assign(bucket_count, std::vector<uint32_t>());
+            return;
+        }
+        for (auto& ids : buckets) {
+            ids.clear();
+        }
+    }
+
+    void build(const std::vector<AABB>& boxes) {
+        reset(tune_cell_size(boxes), boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            insert(i, boxes[i]);
+        }
+    }
+
+    void insert(uint32_t id, const AABB& box) {
+        for_each_cell(box, [&](const GridCell& cell) { bucket(cell).push_back(id); });
+    }
+
+    // The box has to be the one id was inserted with
+    void remove(uint32_t id, const AABB& box) {
+        for_each_cell(box, [&](const GridCell& cell) {
+            std::vector<uint32_t>& ids = bucket(cell);
+            ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        });
+    }
+
+    // Calls visit(id) for everything binned in the cells the segment from a to b passes through,
+    // walking them in order with a 3D DDA
+    template <typename Visitor>
+    void query_segment(const glm::vec3& a, const glm::vec3& b, Visitor visit) const {
+        if (buckets.empty()) {
+            return;
+        }
+        GridCell cell = cell_of(a);
+        GridCell end = cell_of(b);
+        glm::vec3 d = b - a;
+
+        int step[3];
+        float t_next[3];
+        float t_delta[3];
+        int64_t steps = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            step[axis] = end.v[axis] > cell.v[axis] ? 1 : (end.v[axis] < cell.v[axis] ? -1 : 0);
+            steps += llabs((int64_t)end.v[axis] - cell.v[axis]);
+            if (step[axis] == 0) {
+                t_next[axis] = INFINITY;
+                t_delta[axis] = INFINITY;
+                continue;
+            }
+            float boundary = (cell.v[axis] + (step[axis] > 0 ? 1 : 0)) * cell_size;
+            t_next[axis] = (boundary - a[axis]) / d[axis];
+            t_delta[axis] = cell_size / fabsf(d[axis]);
+        }
+
+        visit_bucket(cell, visit);
+        // Every step moves one cell closer to the end cell along one axis, so rounding can't make
+        // the walk overshoot or run forever
+        for (int64_t i = 0; i < steps; i++) {
+            int axis = -1;
+            for (int k = 0; k < 3; k++) {
+                if (cell.v[k] != end.v[k] && (axis < 0 || t_next[k] < t_next[axis])) {
+                    axis = k;
+                }
+            }
+            cell.v[axis] += step[axis];
+            t_next[axis] += t_delta[axis];
+            visit_bucket(cell, visit);
+        }
+    }
+
+    // Calls visit(id) for everything binned in the cells the box overlaps
+    template <typename Visitor> void query_box(const AABB& box, Visitor visit) const {
+        if (buckets.empty()) {
+            return;
+        }
+        for_each_cell(box, [&](const GridCell& cell) { visit_bucket(cell, visit); });
+    }
+
+  private:
+    int32_t coordinate(float value) const {
+        float c = floorf(value / cell_size);
+        return (int32_t)glm::clamp(c, -GRID_MAX_CELL, GRID_MAX_CELL);
+    }
+
+    GridCell cell_of(const glm::vec3& p) const {
+        return (GridCell){{coordinate(p.x), coordinate(p.y), coordinate(p.z)}};
+    }
+
+    size_t bucket_index(const GridCell& cell) const {
+        uint32_t h = (uint32_t)cell.v[0] * 73856093u ^ (uint32_t)cell.v[1] * 19349663u ^
+                     (uint32_t)cell.v[2] * 83492791u;
+        return h & (buckets.size() - 1);
+    }
+
+    std::vector<uint32_t>& bucket(const GridCell& cell) {
+        return buckets[bucket_index(cell)];
+    }
+
+    template <typename Visitor> void visit_bucket(const GridCell& cell, Visitor& visit) const {
+        for (auto id : buckets[bucket_index(cell)]) {
+            visit(id);
+        }
+    }
+
+    template <typename Function> void for_each_cell(const AABB& box, Function fn) const {
+        glm::vec3 margin(GRID_CELL_MARGIN * cell_size);
+        GridCell lo = cell_of(box.min - margin);
+        GridCell hi = cell_of(box.max + margin);
+        GridCell cell;
+        for (cell.v[2] = lo.v[2]; cell.v[2] <= hi.v[2]; cell.v[2]++) {
+            for (cell.v[1] = lo.v[1]; cell.v[1] <= hi.v[1]; cell.v[1]++) {
+                for (cell.v[0] = lo.v[0]; cell.v[0] <= hi.v[0]; cell.v[0]++) {
+                    fn(cell);
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "../include/glm/glm.hpp"
+#include "bvh.hpp"
+#include "geometry.hpp"
+#include "intersection.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+
+#ifndef sweep_and_prune_hpp
+#define sweep_and_prune_hpp
+
+// One end of a box along the sweep axis. key is the box index shifted left by one with the low bit
+// set for the max end, so at equal values a min sorts first and touching boxes still overlap.
+struct SweepEndpoint {
+    float value;
+    uint32_t key;
+};
+
+bool operator<(const SweepEndpoint& a, const SweepEndpoint& b) {
+    return a.value < b.value || (a.value == b.value && (a.key & 1) < (b.key & 1));
+}
+
+// Sort-and-sweep broad phase over the boxes of every line and triangle. The endpoints are kept
+// sorted along all three axes between frames and re-sorted with insertion sort after things move,
+// which costs little more than a pass over them when motion is small. The overlapping pairs are
+// kept too and only change where the sort swaps endpoints: a min passing a max going down starts
+// an overlap along that axis, so the pair is added if the boxes overlap on the other axes as well,
+// and a max passing a min ends one. Any change in overlap is a swap on some axis, so the pairs stay
+// exact at O(n + swaps) per frame. Lines are boxes [0, line_count) and triangles follow. Adding or
+// removing primitives needs another build().
+class SweepAndPrune {
+  public:
+    size_t swap_count; // insertion sort swaps the last update() needed, over all three axes
+
+    SweepAndPrune()
+        : swap_count(0), line_count(0), boxes(), previous_boxes(), endpoints(), overlapping(),
+          active_lines(), active_triangles(), active_slot(), candidates() {}
+
+    // Sorts from scratch and finds the overlapping pairs with one sweep along the axis the box
+    // centers spread out the most on
+    void build(const TriangleStore& triangles, const LineStore& lines) {
+        line_count = lines.size();
+        refresh_boxes(triangles, lines);
+
+        glm::vec3 mean(0.0f), square(0.0f);
+        for (const auto& box : boxes) {
+            glm::vec3 c = centroid(box);
+            mean += c;
+            square += c * c;
+        }
+        if (!boxes.empty()) {
+            mean /= (float)boxes.size();
+            square /= (float)boxes.size();
+        }
+        glm::vec3 variance = square - mean * mean;
+        int axis = 0;
+        if (variance.y > variance[axis]) {
+            axis = 1;
+        }
+        if (variance.z > variance[axis]) {
+            axis = 2;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            endpoints[k].resize(boxes.size() * 2);
+            for (size_t i = 0; i < boxes.size(); i++) {
+                endpoints[k][2 * i].key = (uint32_t)i << 1;
+                endpoints[k][2 * i + 1].key = (uint32_t)i << 1 | 1;
+            }
+            refresh_endpoints(k);
+            std::sort(endpoints[k].begin(), endpoints[k].end());
+        }
+        active_slot.assign(boxes.size(), 0);
+        sweep(axis);
+        swap_count = 0;
+    }
+
+    // Picks up new positions from the stores, restores the endpoint order and updates the
+    // overlapping pairs from the swaps
+    void update(const TriangleStore& triangles, const LineStore& lines) {
+        previous_boxes.swap(boxes);
+        refresh_boxes(triangles, lines);
+        swap_count = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            refresh_endpoints(axis);
+            std::vector<SweepEndpoint>& sorted = endpoints[axis];
+            for (size_t i = 1; i < sorted.size(); i++) {
+                SweepEndpoint endpoint = sorted[i];
+                size_t j = i;
+                while (j > 0 && endpoint < sorted[j - 1]) {
+                    passed(endpoint, sorted[j - 1]);
+                    sorted[j] = sorted[j - 1];
+                    j--;
+                }
+                sorted[j] = endpoint;
+                swap_count += i - j;
+            }
+        }
+    }
+
+    // Every line and triangle whose boxes overlap, ordered by line and then triangle
+    void find_candidates(std::vector<HitPair>& pairs) const {
+        pairs.clear();
+        pairs.reserve(overlapping.size());
+        for (auto key : overlapping) {
+            pairs.push_back((HitPair){.line = (uint32_t)(key >> 32), .triangle = (uint32_t)key});
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const HitPair& a, const HitPair& b) {
+            return a.line < b.line || (a.line == b.line && a.triangle < b.triangle);
+        });
+    }
+
+    // Runs the candidates through intersects(), ordered like find_hits()
+    void find_hits(const TriangleStore& triangles, const LineStore& lines,
+                   NarrowPhase narrow_phase, std::vector<HitPair>& hits) {
+        find_candidates(candidates);
+        hits.clear();
+        for (const auto& pair : candidates) {
+            if (intersects(lines[pair.line], triangles[pair.triangle], narrow_phase)) {
+                hits.push_back(pair);
+            }
+        }
+    }
+
+    size_t candidate_count() const {
+        return candidates.size();
+    }
+
+  private:
+    // A box the sweep is inside of, with its extent along the other two axes kept next to it so
+    // the inner loop reads memory in order
+    struct ActiveBox {
+        float min_a, max_a;
+        float min_b, max_b;
+        uint32_t index;
+    };
+
+    size_t line_count;
+    std::vector<AABB> boxes;
+    std::vector<AABB> previous_boxes; // as of the last update(), to skip most removals
+    std::vector<SweepEndpoint> endpoints[3];
+
+    // Overlapping (line, triangle) pairs as line << 32 | triangle
+    std::unordered_set<uint64_t> overlapping;
+
+    // Boxes the build sweep is inside of, and where each one sits in its list
+    std::vector<ActiveBox> active_lines;
+    std::vector<ActiveBox> active_triangles;
+    std::vector<uint32_t> active_slot;
+
+    std::vector<HitPair> candidates;
+
+    SweepAndPrune(const SweepAndPrune&);
+    SweepAndPrune& operator=(const SweepAndPrune&);
+
+    void refresh_boxes(const TriangleStore& triangles, const LineStore& lines) {
+        boxes.resize(lines.size() + triangles.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            boxes[i] = line_bounds(lines.a_pos[i], lines.b_pos[i]);
+        }
+        for (size_t j = 0; j < triangles.size(); j++) {
+            boxes[line_count + j] =
+                triangle_bounds(triangles.a_pos[j], triangles.b_pos[j], triangles.c_pos[j]);
+        }
+    }
+
+    ActiveBox make_active_box(uint32_t box, int axis_a, int axis_b) const {
+        const AABB& b = boxes[box];
+        return (ActiveBox){.min_a = b.min[axis_a], .max_a = b.max[axis_a], .min_b = b.min[axis_b],
+                           .max_b = b.max[axis_b], .index = box};
+    }
+
+    void refresh_endpoints(int axis) {
+        for (auto& endpoint : endpoints[axis]) {
+            const AABB& box = boxes[endpoint.key >> 1];
+            endpoint.value = (endpoint.key & 1) ? box.max[axis] : box.min[axis];
+        }
+    }
+
+    uint64_t pair_key(uint32_t a, uint32_t b) const {
+        uint32_t line = a < line_count ? a : b;
+        uint32_t triangle = (a < line_count ? b : a) - line_count;
+        return (uint64_t)line << 32 | triangle;
+    }
+
+    // Called when the insertion sort moves endpoint down past other
+    void passed(const SweepEndpoint& endpoint, const SweepEndpoint& other) {
+        uint32_t a = endpoint.key >> 1;
+        uint32_t b = other.key >> 1;
+        if ((a < line_count) == (b < line_count) || (endpoint.key & 1) == (other.key & 1)) {
+            return;
+        }
+        if (endpoint.key & 1) {
+            // A pair can only be kept if its boxes overlapped before the move. Anything added
+            // during this update overlaps after it, so it can't be losing an overlap here.
+            if (overlaps(previous_boxes[a], previous_boxes[b])) {
+                overlapping.erase(pair_key(a, b));
+            }
+        } else if (overlaps(boxes[a], boxes[b])) {
+            overlapping.insert(pair_key(a, b));
+        }
+    }
+
+    // Finds every overlapping pair from scratch with the sorted endpoints of one axis
+    void sweep(int axis) {
+        overlapping.clear();
+        active_lines.clear();
+        active_triangles.clear();
+        int axis_a = (axis + 1) % 3;
+        int axis_b = (axis + 2) % 3;
+        for (const auto& endpoint : endpoints[axis]) {
+            uint32_t box = endpoint.key >> 1;
+            bool is_line = box < line_count;
+            std::vector<ActiveBox>& own = is_line ? active_lines : active_triangles;
+            if (endpoint.key & 1) {
+                // Swap-and-pop out of the active list
+                uint32_t slot = active_slot[box];
+                own[slot] = own.back();
+                active_slot[own[slot].index] = slot;
+                own.pop_back();
+                continue;
+            }
+            // Everything still active overlaps along the sweep axis, so check the other two. The
+            // comparisons are combined without short circuits since about half of them fail at
+            // random, which costs more in mispredicted branches than the comparisons themselves.
+            ActiveBox entry = make_active_box(box, axis_a, axis_b);
+            const std::vector<ActiveBox>& other = is_line ? active_triangles : active_lines;
+            for (const auto& active : other) {
+                if ((entry.min_a <= active.max_a) & (entry.max_a >= active.min_a) &
+                    (entry.min_b <= active.max_b) & (entry.max_b >= active.min_b)) {
+                    overlapping.insert(pair_key(box, active.index));
+                }
+            }
+            active_slot[box] = own.size();
+            own.push_back(entry);
+        }
+    }
+};
+
+#endif
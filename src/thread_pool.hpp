@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+#ifndef thread_pool_hpp
+#define thread_pool_hpp
+
+// Fixed set of worker threads that run one parallel_for at a time. The calling thread takes part
+// as worker 0 so a pool of size 1 runs everything inline.
+class ThreadPool {
+  public:
+    explicit ThreadPool(size_t thread_count)
+        : workers(), mutex(), wake(), done(), job(), job_count(0), next_job(0), generation(0),
+          busy(0), stopping(false) {
+        for (size_t i = 1; i < std::max<size_t>(thread_count, 1); i++) {
+            workers.push_back(std::thread(&ThreadPool::run, this, i));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    size_t size() const {
+        return workers.size() + 1;
+    }
+
+    // Calls fn(job, worker) for every job in [0, count) and returns once all of them are done.
+    // worker is in [0, size()) and can be used to index per-thread state.
+    void parallel_for(size_t count, const std::function<void(size_t, size_t)>& fn) {
+        if (workers.empty() || count <= 1) {
+            for (size_t i = 0; i < count; i++) {
+                fn(i, 0);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = fn;
+            job_count = count;
+            next_job = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        job = nullptr;
+    }
+
+  private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(size_t, size_t)> job;
+    size_t job_count;
+    std::atomic<size_t> next_job;
+    size_t generation;
+    size_t busy;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work(size_t worker) {
+        for (size_t i = next_job++; i < job_count; i = next_job++) {
+            job(i, worker);
+        }
+    }
+
+    void run(size_t worker) {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            work(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy--;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+// Pool shared by the passes that take a thread count, recreated when a different count is asked for
+ThreadPool& shared_thread_pool(size_t thread_count) {
+    static ThreadPool* pool = NULL;
+    thread_count = std::max<size_t>(thread_count, 1);
+    if (pool == NULL || pool->size() != thread_count) {
+        delete pool;
+        pool = new ThreadPool(thread_count);
+    }
+    return *pool;
+}
+
+// Per-thread buffers and chunk bookkeeping of parallel_collect(). Callers that collect every frame
+// keep one around so the storage is reused.
+template <typename T> struct CollectScratch {
+    std::vector<std::vector<T> > buffers;
+    std::vector<size_t> chunk_worker;
+    std::vector<size_t> chunk_begin;
+    std::vector<size_t> chunk_end;
+};
+
+// Splits [0, item_count) into chunks of chunk_size and calls fn(item, worker, buffer) for every
+// item, where buffer is a per-thread vector to append results to. The results are then merged into
+// out in item order, so they don't depend on the thread count or on which thread ran which chunk.
+template <typename T, typename Function>
+void parallel_collect(ThreadPool& pool, size_t item_count, size_t chunk_size, std::vector<T>& out,
+                      Function fn, CollectScratch<T>& scratch) {
+    // Every thread appends to its own buffer and remembers which part of it each chunk wrote
+    size_t chunk_count = (item_count + chunk_size - 1) / chunk_size;
+    scratch.buffers.resize(pool.size());
+    for (auto& buffer : scratch.buffers) {
+        buffer.clear();
+    }
+    scratch.chunk_worker.resize(chunk_count);
+    scratch.chunk_begin.resize(chunk_count);
+    scratch.chunk_end.resize(chunk_count);
+
+    // Only a pointer is captured so the job fits in std::function without allocating
+    struct Job {
+        CollectScratch<T>& scratch;
+        size_t item_count;
+        size_t chunk_size;
+        Function& fn;
+    } job = {scratch, item_count, chunk_size, fn};
+    Job* state = &job;
+    pool.parallel_for(chunk_count, [state](size_t chunk, size_t worker) {
+        std::vector<T>& buffer = state->scratch.buffers[worker];
+        state->scratch.chunk_worker[chunk] = worker;
+        state->scratch.chunk_begin[chunk] = buffer.size();
+        size_t end = std::min(state->item_count, (chunk + 1) * state->chunk_size);
+        for (size_t item = chunk * state->chunk_size; item < end; item++) {
+            state->fn(item, worker, buffer);
+        }
+        state->scratch.chunk_end[chunk] = buffer.size();
+    });
+
+    out.clear();
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+        const std::vector<T>& buffer = scratch.buffers[scratch.chunk_worker[chunk]];
+        out.insert(out.end(), buffer.begin() + scratch.chunk_begin[chunk],
+                   buffer.begin() + scratch.chunk_end[chunk]);
+    }
+}
+
+template <typename T, typename Function>
+void parallel_collect(ThreadPool& pool, size_t item_count, size_t chunk_size, std::vector<T>& out,
+                      Function fn) {
+    CollectScratch<T> scratch;
+    parallel_collect(pool, item_count, chunk_size, out, fn, scratch);
+}
+
+size_t default_thread_count() {
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "../include/glm/glm.hpp"
+#include "geometry.hpp"
+
+#include <stddef.h>
+#include <vector>
+
+#ifndef triangle_record_hpp
+#define triangle_record_hpp
+
+// Everything the segment test needs about a triangle, computed once per triangle instead of once
+// per test. The normal is left unnormalized since only its direction and the sign of distances
+// along it are used.
+struct TriangleRecord {
+    glm::vec3 a;  // first corner
+    glm::vec3 e1; // b - a
+    glm::vec3 e2; // c - a
+    glm::vec3 n;  // cross(e1, e2)
+    float d;      // dot(n, a), so the plane is every p with dot(n, p) == d
+};
+
+TriangleRecord make_triangle_record(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    TriangleRecord record;
+    record.a = a;
+    record.e1 = b - a;
+    record.e2 = c - a;
+    record.n = glm::cross(record.e1, record.e2);
+    record.d = glm::dot(record.n, a);
+    return record;
+}
+
+void make_triangle_records(const TriangleStore& triangles, std::vector<TriangleRecord>& records) {
+    records.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        records[i] =
+            make_triangle_record(triangles.a_pos[i], triangles.b_pos[i], triangles.c_pos[i]);
+    }
+}
+
+// Moller-Trumbore test of the segment from p to q against a triangle, with no square roots and no
+// dependence on winding. Segments whose ends are strictly on the same side of the plane are
+// rejected first, which is most of them.
+bool intersects_segment(const glm::vec3& p, const glm::vec3& q, const TriangleRecord& tri) {
+    float dp = glm::dot(tri.n, p) - tri.d;
+    float dq = glm::dot(tri.n, q) - tri.d;
+    if ((dp > 0.0f && dq > 0.0f) || (dp < 0.0f && dq < 0.0f)) {
+        return false;
+    }
+
+    glm::vec3 dir = q - p;
+    glm::vec3 pvec = glm::cross(dir, tri.e2);
+    float det = glm::dot(tri.e1, pvec);
+    if (det == 0.0f) {
+        // Parallel to the plane (or a degenerate triangle)
+        return false;
+    }
+    float inv_det = 1.0f / det;
+
+    glm::vec3 tvec = p - tri.a;
+    float u = glm::dot(tvec, pvec) * inv_det;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    glm::vec3 qvec = glm::cross(tvec, tri.e1);
+    float v = glm::dot(dir, qvec) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    float t = glm::dot(tri.e2, qvec) * inv_det;
+    return t >= 0.0f && t <= 1.0f;
+}
+
+// Where the line through p and q crosses the plane of a triangle: the segment parameter t (0 at p,
+// 1 at q) and the barycentric weights u and v of the second and third corners. Only meaningful for
+// pairs a narrow phase reported as hits. Returns false when the segment is parallel to the plane.
+bool segment_hit_parameters(const glm::vec3& p, const glm::vec3& q, const TriangleRecord& tri,
+                            float& t, float& u, float& v) {
+    glm::vec3 dir = q - p;
+    glm::vec3 pvec = glm::cross(dir, tri.e2);
+    float det = glm::dot(tri.e1, pvec);
+    if (det == 0.0f) {
+        t = 0.0f;
+        u = 0.0f;
+        v = 0.0f;
+        return false;
+    }
+    float inv_det = 1.0f / det;
+    glm::vec3 tvec = p - tri.a;
+    glm::vec3 qvec = glm::cross(tvec, tri.e1);
+    u = glm::dot(tvec, pvec) * inv_det;
+    v = glm::dot(dir, qvec) * inv_det;
+    t = glm::dot(tri.e2, qvec) * inv_det;
+    return true;
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "../include/glm/glm.hpp"
+
+#include <math.h>
+#include <utility>
+
+#ifndef triangle_triangle_hpp
+#define triangle_triangle_hpp
+
+// Tomas Moller's "A Fast Triangle-Triangle Intersection Test". Each triangle has to cross the
+// plane of the other one, and then the intervals the two triangles cover on the line where the
+// planes meet have to overlap. Triangles in the same plane fall back to a 2D test. Touching
+// counts as overlapping.
+
+// Orientation of c relative to the directed line through a and b in 2D
+float orient2d(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+bool segments_intersect_2d(const glm::vec2& p0, const glm::vec2& p1, const glm::vec2& q0,
+                           const glm::vec2& q1) {
+    float d0 = orient2d(p0, p1, q0);
+    float d1 = orient2d(p0, p1, q1);
+    float d2 = orient2d(q0, q1, p0);
+    float d3 = orient2d(q0, q1, p1);
+    if (((d0 > 0.0f && d1 < 0.0f) || (d0 < 0.0f && d1 > 0.0f)) &&
+        ((d2 > 0.0f && d3 < 0.0f) || (d2 < 0.0f && d3 > 0.0f))) {
+        return true;
+    }
+    // Collinear cases, where an end of one segment lies on the other
+    glm::vec2 p_lo = glm::min(p0, p1), p_hi = glm::max(p0, p1);
+    glm::vec2 q_lo = glm::min(q0, q1), q_hi = glm::max(q0, q1);
+    return (d0 == 0.0f && glm::all(glm::lessThanEqual(p_lo, q0)) &&
+            glm::all(glm::lessThanEqual(q0, p_hi))) ||
+           (d1 == 0.0f && glm::all(glm::lessThanEqual(p_lo, q1)) &&
+            glm::all(glm::lessThanEqual(q1, p_hi))) ||
+           (d2 == 0.0f && glm::all(glm::lessThanEqual(q_lo, p0)) &&
+            glm::all(glm::lessThanEqual(p0, q_hi))) ||
+           (d3 == 0.0f && glm::all(glm::lessThanEqual(q_lo, p1)) &&
+            glm::all(glm::lessThanEqual(p1, q_hi)));
+}
+
+// Inside or on the edges of the triangle, for either winding
+bool point_in_triangle_2d(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b,
+                          const glm::vec2& c) {
+    float ab = orient2d(a, b, p);
+    float bc = orient2d(b, c, p);
+    float ca = orient2d(c, a, p);
+    return (ab >= 0.0f && bc >= 0.0f && ca >= 0.0f) || (ab <= 0.0f && bc <= 0.0f && ca <= 0.0f);
+}
+
+// The two axes kept when points in the plane with normal n are projected onto the axis plane the
+// normal is closest to
+void projection_axes(const glm::vec3& n, int& i0, int& i1) {
+    glm::vec3 a = glm::abs(n);
+    i0 = 1; // drop x
+    i1 = 2;
+    if (a.y >= a.x && a.y >= a.z) {
+        i0 = 0;
+        i1 = 2;
+    } else if (a.z >= a.x && a.z >= a.y) {
+        i0 = 0;
+        i1 = 1;
+    }
+}
+
+// Both triangles lie in the plane with normal n. They are projected onto the axis plane the
+// normal is closest to and overlap if any edges cross or one contains the other.
+bool coplanar_triangles_intersect(const glm::vec3& n, const glm::vec3 v[3],
+                                  const glm::vec3 u[3]) {
+    int i0, i1;
+    projection_axes(n, i0, i1);
+    glm::vec2 v2[3], u2[3];
+    for (int k = 0; k < 3; k++) {
+        v2[k] = glm::vec2(v[k][i0], v[k][i1]);
+        u2[k] = glm::vec2(u[k][i0], u[k][i1]);
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (segments_intersect_2d(v2[i], v2[(i + 1) % 3], u2[j], u2[(j + 1) % 3])) {
+                return true;
+            }
+        }
+    }
+    return point_in_triangle_2d(v2[0], u2[0], u2[1], u2[2]) ||
+           point_in_triangle_2d(u2[0], v2[0], v2[1], v2[2]);
+}
+
+// Whether the segment pq touches the triangle t. A segment in the plane of the triangle is tested
+// in 2D like coplanar triangles.
+bool segment_triangle_intersect(const glm::vec3& p, const glm::vec3& q, const glm::vec3 t[3]) {
+    glm::vec3 n = glm::cross(t[1] - t[0], t[2] - t[0]);
+    float dp = glm::dot(n, p - t[0]);
+    float dq = glm::dot(n, q - t[0]);
+    if ((dp > 0.0f && dq > 0.0f) || (dp < 0.0f && dq < 0.0f)) {
+        return false;
+    }
+    if (dp == 0.0f && dq == 0.0f) {
+        int i0, i1;
+        projection_axes(n, i0, i1);
+        glm::vec2 p2(p[i0], p[i1]), q2(q[i0], q[i1]);
+        glm::vec2 t2[3];
+        for (int k = 0; k < 3; k++) {
+            t2[k] = glm::vec2(t[k][i0], t[k][i1]);
+        }
+        for (int k = 0; k < 3; k++) {
+            if (segments_intersect_2d(p2, q2, t2[k], t2[(k + 1) % 3])) {
+                return true;
+            }
+        }
+        return point_in_triangle_2d(p2, t2[0], t2[1], t2[2]);
+    }
+    // Where the segment meets the plane, inside or on all three edges
+    glm::vec3 x = p + (q - p) * (dp / (dp - dq));
+    for (int k = 0; k < 3; k++) {
+        if (glm::dot(glm::cross(t[(k + 1) % 3] - t[k], x - t[k]), n) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Where a triangle crosses the line the two planes meet on. p are its corners projected onto the
+// line and d their signed distances to the other plane. Returns false if all three are in it.
+bool plane_interval(const float p[3], const float d[3], float& lo, float& hi) {
+    // Pick the corner that is alone on its side of the plane
+    int alone;
+    if (d[0] * d[1] > 0.0f) {
+        alone = 2;
+    } else if (d[0] * d[2] > 0.0f) {
+        alone = 1;
+    } else if (d[1] * d[2] > 0.0f || d[0] != 0.0f) {
+        alone = 0;
+    } else if (d[1] != 0.0f) {
+        alone = 1;
+    } else if (d[2] != 0.0f) {
+        alone = 2;
+    } else {
+        return false;
+    }
+    int i = (alone + 1) % 3;
+    int j = (alone + 2) % 3;
+    lo = p[alone] + (p[i] - p[alone]) * d[alone] / (d[alone] - d[i]);
+    hi = p[alone] + (p[j] - p[alone]) * d[alone] / (d[alone] - d[j]);
+    if (lo > hi) {
+        std::swap(lo, hi);
+    }
+    return true;
+}
+
+bool triangles_intersect(const glm::vec3 v[3], const glm::vec3 u[3]) {
+    // Corners of u against the plane of v
+    glm::vec3 n1 = glm::cross(v[1] - v[0], v[2] - v[0]);
+    float d1 = -glm::dot(n1, v[0]);
+    float du[3];
+    for (int k = 0; k < 3; k++) {
+        du[k] = glm::dot(n1, u[k]) + d1;
+    }
+    if ((du[0] > 0.0f && du[1] > 0.0f && du[2] > 0.0f) ||
+        (du[0] < 0.0f && du[1] < 0.0f && du[2] < 0.0f)) {
+        return false;
+    }
+
+    // Corners of v against the plane of u
+    glm::vec3 n2 = glm::cross(u[1] - u[0], u[2] - u[0]);
+    float d2 = -glm::dot(n2, u[0]);
+    float dv[3];
+    for (int k = 0; k < 3; k++) {
+        dv[k] = glm::dot(n2, v[k]) + d2;
+    }
+    if ((dv[0] > 0.0f && dv[1] > 0.0f && dv[2] > 0.0f) ||
+        (dv[0] < 0.0f && dv[1] < 0.0f && dv[2] < 0.0f)) {
+        return false;
+    }
+
+    // Project onto the largest axis of the line the planes meet on, which keeps the order of
+    // points along it
+    glm::vec3 line = glm::abs(glm::cross(n1, n2));
+    int axis = 0;
+    if (line.y > line.x && line.y >= line.z) {
+        axis = 1;
+    } else if (line.z > line.x && line.z > line.y) {
+        axis = 2;
+    }
+    float vp[3] = {v[0][axis], v[1][axis], v[2][axis]};
+    float up[3] = {u[0][axis], u[1][axis], u[2][axis]};
+
+    float v_lo, v_hi, u_lo, u_hi;
+    if (!plane_interval(vp, dv, v_lo, v_hi) || !plane_interval(up, du, u_lo, u_hi)) {
+        return coplanar_triangles_intersect(n1, v, u);
+    }
+    return !(v_hi < u_lo || u_hi < v_lo);
+}
+
+#endif
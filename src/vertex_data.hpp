@@ -0,0 +1,538 @@
+#include "../include/glm/glm.hpp"
+#include "../include/glm/gtc/matrix_transform.hpp"
+#include "../include/glm/gtc/packing.hpp"
+#include "constants.hpp"
+#include "geometry.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#ifndef vertex_data_hpp
+#define vertex_data_hpp
+
+// Largest vertex span a 16-bit index batch can address relative to its base vertex
+const uint32_t MAX_INDEX16_SPAN = 0xFFFF;
+
+// Dirty byte ranges closer than this are flushed as one, since every upload call has a fixed cost
+const size_t DIRTY_RANGE_MERGE_GAP = 256;
+
+// Default distance under which triangle corners with the same color are welded into one vertex
+const float WELD_EPSILON = 1e-6f;
+
+enum class PrimitiveType { TRIANGLES, LINES };
+
+enum class IndexType { U16, U32 };
+
+// One draw call worth of indices. first counts elements into the index array matching index_type
+// and base_vertex is added to every index when drawing.
+struct DrawBatch {
+    PrimitiveType primitive;
+    IndexType index_type;
+    size_t first;
+    size_t count;
+    int32_t base_vertex;
+};
+
+enum class PositionFormat {
+    FLOAT32,    // 3 floats
+    HALF_FLOAT, // 4 halfs, the last one padding
+    SNORM16     // 4 normalized shorts relative to the mesh bounds, the last one padding
+};
+
+enum class ColorFormat {
+    FLOAT32, // 3 floats
+    UNORM8   // 4 normalized bytes, alpha always 255
+};
+
+struct VertexFormat {
+    bool interleaved; // Position and color next to each other instead of all positions first
+    PositionFormat position;
+    ColorFormat color;
+};
+
+// Named formats that can be picked on the command line
+const VertexFormat PLANAR_FORMAT = {false, PositionFormat::FLOAT32, ColorFormat::FLOAT32};
+const VertexFormat INTERLEAVED_FORMAT = {true, PositionFormat::FLOAT32, ColorFormat::FLOAT32};
+const VertexFormat PACKED_FORMAT = {true, PositionFormat::HALF_FLOAT, ColorFormat::UNORM8};
+const VertexFormat QUANTIZED_FORMAT = {true, PositionFormat::SNORM16, ColorFormat::UNORM8};
+
+enum class ComponentType { FLOAT, HALF_FLOAT, SHORT, UNSIGNED_BYTE };
+
+// Where one attribute lives in the vertex buffer, in the terms glVertexAttribPointer wants
+struct VertexAttribute {
+    ComponentType type;
+    int components;
+    bool normalized;
+    size_t stride;
+    size_t offset;
+};
+
+// How the packed vertices are laid out. Quantized positions have to be multiplied by dequantize
+// (folded into the model matrix) to get back to scene space.
+struct VertexLayout {
+    VertexAttribute position;
+    VertexAttribute color;
+    size_t bytes_per_vertex;
+    glm::mat4 dequantize;
+};
+
+struct VertexDataConfig {
+    bool weld;           // Share triangle corners that have the same position and color
+    float weld_epsilon;  // Spacing of the grid positions and colors are snapped to, 0 for exact
+    bool optimize_cache; // Reorder welded triangles for the post-transform vertex cache
+    VertexFormat format;
+};
+
+VertexDataConfig default_vertex_data_config() {
+    return (VertexDataConfig){.weld = true, .weld_epsilon = WELD_EPSILON, .optimize_cache = true,
+                              .format = PLANAR_FORMAT};
+}
+
+// What welding and cache optimization did to the triangle part of the mesh
+struct MeshStats {
+    size_t corner_count;
+    size_t triangle_vertex_count;
+    float acmr_before;
+    float acmr_after;
+};
+
+// Packed vertices plus the index data to draw them. 16-bit and 32-bit indices live in separate
+// arrays that end up back to back in one index buffer (see index32_byte_offset).
+struct MeshData {
+    std::vector<uint8_t> vertex_data;
+    size_t vertex_count;
+    VertexFormat format;
+    VertexLayout layout;
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+    std::vector<DrawBatch> batches;
+    MeshStats stats;
+    bool welded; // Triangle corners share vertices, so one triangle can't be recolored alone
+};
+
+// Byte ranges [first, second) of a buffer that changed since it was last uploaded
+struct DirtyRanges {
+    std::vector<std::pair<size_t, size_t> > ranges;
+};
+
+void add_dirty_range(DirtyRanges& dirty, size_t begin, size_t end) {
+    dirty.ranges.push_back(std::make_pair(begin, end));
+}
+
+// Sorts the ranges and merges the ones that overlap or are less than max_gap bytes apart
+void coalesce_dirty_ranges(DirtyRanges& dirty, size_t max_gap = DIRTY_RANGE_MERGE_GAP) {
+    std::vector<std::pair<size_t, size_t> >& ranges = dirty.ranges;
+    if (ranges.empty()) {
+        return;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    size_t last = 0;
+    for (size_t i = 1; i < ranges.size(); i++) {
+        if (ranges[i].first <= ranges[last].second + max_gap) {
+            ranges[last].second = std::max(ranges[last].second, ranges[i].second);
+        } else {
+            ranges[++last] = ranges[i];
+        }
+    }
+    ranges.resize(last + 1);
+}
+
+size_t dirty_bytes(const DirtyRanges& dirty) {
+    size_t bytes = 0;
+    for (const auto& range : dirty.ranges) {
+        bytes += range.second - range.first;
+    }
+    return bytes;
+}
+
+size_t index_size(IndexType type) {
+    return type == IndexType::U16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// 32-bit indices start after the 16-bit ones, rounded up to keep them 4 byte aligned
+size_t index32_byte_offset(const MeshData& mesh) {
+    return (mesh.indices16.size() * sizeof(uint16_t) + 3) & ~(size_t)3;
+}
+
+size_t index_data_size(const MeshData& mesh) {
+    return index32_byte_offset(mesh) + mesh.indices32.size() * sizeof(uint32_t);
+}
+
+size_t index_byte_offset(const MeshData& mesh, const DrawBatch& batch) {
+    if (batch.index_type == IndexType::U16) {
+        return batch.first * sizeof(uint16_t);
+    }
+    return index32_byte_offset(mesh) + batch.first * sizeof(uint32_t);
+}
+
+void add_batch(MeshData& mesh, PrimitiveType primitive, IndexType index_type,
+               const uint32_t* indices, size_t count, uint32_t base_vertex) {
+    if (count == 0) {
+        return;
+    }
+    DrawBatch batch;
+    batch.primitive = primitive;
+    batch.index_type = index_type;
+    batch.count = count;
+    batch.base_vertex = base_vertex;
+    if (index_type == IndexType::U16) {
+        batch.first = mesh.indices16.size();
+        for (size_t i = 0; i < count; i++) {
+            mesh.indices16.push_back(indices[i] - base_vertex);
+        }
+    } else {
+        batch.first = mesh.indices32.size();
+        mesh.indices32.insert(mesh.indices32.end(), indices, indices + count);
+    }
+    mesh.batches.push_back(batch);
+}
+
+// Splits a list of primitives into batches of 16-bit indices relative to a base vertex. A batch
+// is closed as soon as the next primitive would make it span more than 16 bits can address. Only
+// primitives that span more than that on their own fall back to 32-bit indices. Offsets go
+// through data() since the last batch may start at the end of indices.
+void add_batches(MeshData& mesh, PrimitiveType primitive, const std::vector<uint32_t>& indices,
+                 size_t vertices_per_primitive) {
+    size_t start = 0;
+    uint32_t lo = UINT32_MAX;
+    uint32_t hi = 0;
+    size_t wide_start = 0;
+    size_t wide_count = 0;
+    for (size_t i = 0; i < indices.size(); i += vertices_per_primitive) {
+        const uint32_t* prim = indices.data() + i;
+        uint32_t prim_lo = *std::min_element(prim, prim + vertices_per_primitive);
+        uint32_t prim_hi = *std::max_element(prim, prim + vertices_per_primitive);
+
+        if (prim_hi - prim_lo > MAX_INDEX16_SPAN) {
+            add_batch(mesh, primitive, IndexType::U16, indices.data() + start, i - start, lo);
+            if (wide_count == 0) {
+                wide_start = i;
+            }
+            wide_count += vertices_per_primitive;
+            start = i + vertices_per_primitive;
+            lo = UINT32_MAX;
+            hi = 0;
+            continue;
+        }
+        if (wide_count > 0) {
+            add_batch(mesh, primitive, IndexType::U32, indices.data() + wide_start, wide_count, 0);
+            wide_count = 0;
+        }
+
+        if (std::max(hi, prim_hi) - std::min(lo, prim_lo) > MAX_INDEX16_SPAN) {
+            add_batch(mesh, primitive, IndexType::U16, indices.data() + start, i - start, lo);
+            start = i;
+            lo = prim_lo;
+            hi = prim_hi;
+        } else {
+            lo = std::min(lo, prim_lo);
+            hi = std::max(hi, prim_hi);
+        }
+    }
+    if (wide_count > 0) {
+        add_batch(mesh, primitive, IndexType::U32, indices.data() + wide_start, wide_count, 0);
+    }
+    add_batch(mesh, primitive, IndexType::U16, indices.data() + start, indices.size() - start, lo);
+}
+
+size_t position_size(PositionFormat format) {
+    return format == PositionFormat::FLOAT32 ? 3 * sizeof(float) : 4 * sizeof(uint16_t);
+}
+
+size_t color_size(ColorFormat format) {
+    return format == ColorFormat::FLOAT32 ? 3 * sizeof(float) : 4 * sizeof(uint8_t);
+}
+
+VertexLayout make_vertex_layout(const VertexFormat& format, size_t vertex_count) {
+    VertexLayout layout;
+    size_t position_bytes = position_size(format.position);
+    size_t color_bytes = color_size(format.color);
+    layout.bytes_per_vertex = position_bytes + color_bytes;
+
+    switch (format.position) {
+    case PositionFormat::FLOAT32:
+        layout.position = (VertexAttribute){ComponentType::FLOAT, 3, false, 0, 0};
+        break;
+    case PositionFormat::HALF_FLOAT:
+        layout.position = (VertexAttribute){ComponentType::HALF_FLOAT, 4, false, 0, 0};
+        break;
+    case PositionFormat::SNORM16:
+        layout.position = (VertexAttribute){ComponentType::SHORT, 4, true, 0, 0};
+        break;
+    }
+    if (format.color == ColorFormat::FLOAT32) {
+        layout.color = (VertexAttribute){ComponentType::FLOAT, 3, false, 0, 0};
+    } else {
+        layout.color = (VertexAttribute){ComponentType::UNSIGNED_BYTE, 4, true, 0, 0};
+    }
+
+    if (format.interleaved) {
+        layout.position.stride = layout.bytes_per_vertex;
+        layout.color.stride = layout.bytes_per_vertex;
+        layout.color.offset = position_bytes;
+    } else {
+        // Colors start after all the positions, kept 4 byte aligned
+        layout.position.stride = position_bytes;
+        layout.color.stride = color_bytes;
+        layout.color.offset = (vertex_count * position_bytes + 3) & ~(size_t)3;
+    }
+    layout.dequantize = glm::mat4(1.0f);
+    return layout;
+}
+
+void write_position(uint8_t* out, const glm::vec3& p, PositionFormat format) {
+    if (format == PositionFormat::FLOAT32) {
+        memcpy(out, &p[0], 3 * sizeof(float));
+        return;
+    }
+    uint16_t packed[4];
+    for (int i = 0; i < 3; i++) {
+        packed[i] = format == PositionFormat::HALF_FLOAT ? glm::packHalf1x16(p[i])
+                                                         : glm::packSnorm1x16(p[i]);
+    }
+    packed[3] = 0;
+    memcpy(out, packed, sizeof(packed));
+}
+
+void write_color(uint8_t* out, const glm::vec3& c, ColorFormat format) {
+    if (format == ColorFormat::FLOAT32) {
+        memcpy(out, &c[0], 3 * sizeof(float));
+        return;
+    }
+    out[0] = glm::packUnorm1x8(c.r);
+    out[1] = glm::packUnorm1x8(c.g);
+    out[2] = glm::packUnorm1x8(c.b);
+    out[3] = 255;
+}
+
+// Vertex v as the vertex shader sees it: quantized positions still have to go through dequantize
+glm::vec3 read_position(const MeshData& mesh, size_t v) {
+    const uint8_t* in =
+        mesh.vertex_data.data() + mesh.layout.position.offset + v * mesh.layout.position.stride;
+    glm::vec3 p;
+    if (mesh.format.position == PositionFormat::FLOAT32) {
+        memcpy(&p[0], in, 3 * sizeof(float));
+        return p;
+    }
+    uint16_t packed[4];
+    memcpy(packed, in, sizeof(packed));
+    for (int i = 0; i < 3; i++) {
+        p[i] = mesh.format.position == PositionFormat::HALF_FLOAT
+                   ? glm::unpackHalf1x16(packed[i])
+                   : glm::unpackSnorm1x16(packed[i]);
+    }
+    return p;
+}
+
+glm::vec3 read_color(const MeshData& mesh, size_t v) {
+    const uint8_t* in =
+        mesh.vertex_data.data() + mesh.layout.color.offset + v * mesh.layout.color.stride;
+    glm::vec3 c;
+    if (mesh.format.color == ColorFormat::FLOAT32) {
+        memcpy(&c[0], in, 3 * sizeof(float));
+        return c;
+    }
+    return glm::vec3(glm::unpackUnorm1x8(in[0]), glm::unpackUnorm1x8(in[1]),
+                     glm::unpackUnorm1x8(in[2]));
+}
+
+// Index k of a batch with its base vertex added, the vertex the GPU would fetch
+uint32_t batch_vertex(const MeshData& mesh, const DrawBatch& batch, size_t k) {
+    if (batch.index_type == IndexType::U16) {
+        return mesh.indices16[batch.first + k] + batch.base_vertex;
+    }
+    return mesh.indices32[batch.first + k] + batch.base_vertex;
+}
+
+// Where pack_vertices() centered and scaled positions, undone again by dequantize
+glm::vec3 quantize_center(const VertexLayout& layout) {
+    return glm::vec3(layout.dequantize[3]);
+}
+
+glm::vec3 quantize_half_extent(const VertexLayout& layout) {
+    return glm::vec3(layout.dequantize[0][0], layout.dequantize[1][1], layout.dequantize[2][2]);
+}
+
+// Writes every vertex in the mesh's format. SNORM16 positions are stored relative to the bounds
+// of the vertices so the full 16 bits cover the scene.
+void pack_vertices(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& colors,
+                   MeshData& mesh) {
+    size_t count = positions.size();
+    VertexLayout& layout = mesh.layout;
+    layout = make_vertex_layout(mesh.format, count);
+
+    glm::vec3 center(0.0f);
+    glm::vec3 half_extent(1.0f);
+    if (mesh.format.position == PositionFormat::SNORM16 && count > 0) {
+        glm::vec3 lo = positions[0];
+        glm::vec3 hi = positions[0];
+        for (const auto& p : positions) {
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        center = (lo + hi) * 0.5f;
+        half_extent = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+        layout.dequantize = glm::scale(glm::translate(glm::mat4(1.0f), center), half_extent);
+    }
+
+    if (count == 0) {
+        mesh.vertex_data.clear();
+        return;
+    }
+    size_t color_bytes = color_size(mesh.format.color);
+    mesh.vertex_data.assign(layout.color.offset + (count - 1) * layout.color.stride + color_bytes,
+                            0);
+
+    uint8_t* data = mesh.vertex_data.data();
+    for (size_t i = 0; i < count; i++) {
+        write_position(data + layout.position.offset + i * layout.position.stride,
+                       (positions[i] - center) / half_extent, mesh.format.position);
+        write_color(data + layout.color.offset + i * layout.color.stride, colors[i],
+                    mesh.format.color);
+    }
+}
+
+void create_vertex_data(const TriangleStore& triangles, const LineStore& lines, MeshData& mesh,
+                        const VertexDataConfig& config = default_vertex_data_config()) {
+    // Triangle corners in drawing order
+    size_t corner_count = triangles.size() * TRI_VERTEX_COUNT;
+    std::vector<glm::vec3> positions(corner_count);
+    std::vector<glm::vec3> colors(corner_count);
+    for (size_t i = 0; i < triangles.size(); i++) {
+        positions[3 * i] = triangles.a_pos[i];
+        positions[3 * i + 1] = triangles.b_pos[i];
+        positions[3 * i + 2] = triangles.c_pos[i];
+        colors[3 * i] = triangles.a_col[i];
+        colors[3 * i + 1] = triangles.b_col[i];
+        colors[3 * i + 2] = triangles.c_col[i];
+    }
+
+    std::vector<uint32_t> indices(corner_count);
+    if (config.weld) {
+        std::vector<glm::vec3> welded_positions;
+        std::vector<glm::vec3> welded_colors;
+        weld_vertices(positions, colors, config.weld_epsilon, welded_positions, welded_colors,
+                      indices);
+        positions.swap(welded_positions);
+        colors.swap(welded_colors);
+    } else {
+        for (size_t i = 0; i < corner_count; i++) {
+            indices[i] = i;
+        }
+    }
+
+    size_t triangle_vertex_count = positions.size();
+    mesh.stats.corner_count = corner_count;
+    mesh.stats.triangle_vertex_count = triangle_vertex_count;
+    mesh.stats.acmr_before = compute_acmr(indices, triangle_vertex_count);
+    if (config.weld && config.optimize_cache) {
+        optimize_vertex_cache(indices, triangle_vertex_count);
+
+        // Keep the vertex order close to the new triangle order so 16-bit batches stay large
+        std::vector<uint32_t> remap;
+        reorder_vertices_by_first_use(indices, triangle_vertex_count, remap);
+        std::vector<glm::vec3> reordered_positions(triangle_vertex_count);
+        std::vector<glm::vec3> reordered_colors(triangle_vertex_count);
+        for (size_t v = 0; v < triangle_vertex_count; v++) {
+            reordered_positions[remap[v]] = positions[v];
+            reordered_colors[remap[v]] = colors[v];
+        }
+        positions.swap(reordered_positions);
+        colors.swap(reordered_colors);
+    }
+    mesh.stats.acmr_after = compute_acmr(indices, triangle_vertex_count);
+
+    // Line vertices follow the triangle ones
+    size_t line_vertex_count = lines.size() * LINE_VERTEX_COUNT;
+    mesh.vertex_count = triangle_vertex_count + line_vertex_count;
+    positions.reserve(mesh.vertex_count);
+    colors.reserve(mesh.vertex_count);
+    for (size_t i = 0; i < lines.size(); i++) {
+        positions.push_back(lines.a_pos[i]);
+        positions.push_back(lines.b_pos[i]);
+        colors.push_back(lines.a_col[i]);
+        colors.push_back(lines.b_col[i]);
+    }
+
+    mesh.format = config.format;
+    mesh.welded = config.weld;
+    pack_vertices(positions, colors, mesh);
+
+    mesh.indices16.clear();
+    mesh.indices32.clear();
+    mesh.batches.clear();
+    add_batches(mesh, PrimitiveType::TRIANGLES, indices, TRI_VERTEX_COUNT);
+
+    // Line vertices are used once each, in order
+    indices.resize(line_vertex_count);
+    for (size_t i = 0; i < line_vertex_count; i++) {
+        indices[i] = triangle_vertex_count + i;
+    }
+    add_batches(mesh, PrimitiveType::LINES, indices, LINE_VERTEX_COUNT);
+}
+
+// Rewrites one vertex in place and records the bytes that changed. Returns false when a quantized
+// position falls outside of the bounds the mesh was packed with.
+bool update_vertex(MeshData& mesh, size_t v, const glm::vec3& position, const glm::vec3& color,
+                   DirtyRanges& dirty) {
+    const VertexLayout& layout = mesh.layout;
+    glm::vec3 p = (position - quantize_center(layout)) / quantize_half_extent(layout);
+    if (mesh.format.position == PositionFormat::SNORM16 &&
+        glm::any(glm::greaterThan(glm::abs(p), glm::vec3(1.0f)))) {
+        return false;
+    }
+
+    uint8_t* data = mesh.vertex_data.data();
+    size_t position_offset = layout.position.offset + v * layout.position.stride;
+    size_t color_offset = layout.color.offset + v * layout.color.stride;
+    write_position(data + position_offset, p, mesh.format.position);
+    write_color(data + color_offset, color, mesh.format.color);
+    if (mesh.format.interleaved) {
+        add_dirty_range(dirty, position_offset, position_offset + layout.bytes_per_vertex);
+    } else {
+        add_dirty_range(dirty, position_offset,
+                        position_offset + position_size(mesh.format.position));
+        add_dirty_range(dirty, color_offset, color_offset + color_size(mesh.format.color));
+    }
+    return true;
+}
+
+// Patches the vertices of the given lines and triangles into the packed data after their colors
+// or positions changed, adding the touched bytes to dirty. Returns false when the mesh has to be
+// rebuilt with create_vertex_data() instead: when primitives were added or removed, when a
+// triangle changed in a welded mesh, or when a quantized position left the packed bounds.
+bool update_vertex_data(const TriangleStore& triangles, const LineStore& lines,
+                        const std::vector<uint32_t>& dirty_triangles,
+                        const std::vector<uint32_t>& dirty_lines, MeshData& mesh,
+                        DirtyRanges& dirty) {
+    size_t line_vertex_offset = mesh.stats.triangle_vertex_count;
+    if (mesh.stats.corner_count != triangles.size() * TRI_VERTEX_COUNT ||
+        mesh.vertex_count != line_vertex_offset + lines.size() * LINE_VERTEX_COUNT) {
+        return false;
+    }
+    if (mesh.welded && !dirty_triangles.empty()) {
+        return false;
+    }
+
+    // Without welding corner k of triangle j is vertex 3j + k
+    bool ok = true;
+    for (auto j : dirty_triangles) {
+        size_t v = j * TRI_VERTEX_COUNT;
+        ok = ok && update_vertex(mesh, v, triangles.a_pos[j], triangles.a_col[j], dirty);
+        ok = ok && update_vertex(mesh, v + 1, triangles.b_pos[j], triangles.b_col[j], dirty);
+        ok = ok && update_vertex(mesh, v + 2, triangles.c_pos[j], triangles.c_col[j], dirty);
+    }
+    for (auto i : dirty_lines) {
+        size_t v = line_vertex_offset + i * LINE_VERTEX_COUNT;
+        ok = ok && update_vertex(mesh, v, lines.a_pos[i], lines.a_col[i], dirty);
+        ok = ok && update_vertex(mesh, v + 1, lines.b_pos[i], lines.b_col[i], dirty);
+    }
+    return ok;
+}
+
+#endif